@@ -34,30 +34,44 @@ LinkAccountHolder::LinkAccountHolder(const LinkID &linkId_, const LinkAddress &a
     Link(linkId_, address_, properties_, isCreator_, transport_, sdk_),
     creator(isCreator_),
     accountHolderTransport(transport_) {
+    RequestLedger::LinkScope ledgerScope(linkId);
 
     // Initialize the policy for the initial Uuids and _n_ forward
-    accountHolderTransport->s3Manager.createBucket(address.fetchBucket, address.region);
-    if (address.fetchBucket != address.postBucket) {
-      accountHolderTransport->s3Manager.createBucket(address.postBucket, address.region);
+    // Every bucket the link is striped across
+    for (auto &bucket : linkBuckets(address)) {
+      accountHolderTransport->s3Manager.createBucket(bucket, address.region);
+    }
+    for (auto &bucket : fetchBuckets(address)) {
+      accountHolderTransport->s3Manager.addObjPermission("*",
+                                                         bucket,
+                                                         "private-puttable",
+                                                         "s3:PutObject",
+                                                         accountHolderTransport->s3Manager.selfPrincipal);
     }
-    accountHolderTransport->s3Manager.addObjPermission("*",
-                                                       address.fetchBucket,
-                                                       "private-puttable",
-                                                       "s3:PutObject",
-                                                       accountHolderTransport->s3Manager.selfPrincipal);
     
-    accountHolderTransport->s3Manager.addObjPermission("*",
-                                                       address.postBucket,
-                                                       "private-gettable",
-                                                       "s3:GetObject",
-                                                       accountHolderTransport->s3Manager.selfPrincipal);
+    for (auto &bucket : postBuckets(address)) {
+      accountHolderTransport->s3Manager.addObjPermission("*",
+                                                         bucket,
+                                                         "private-gettable",
+                                                         "s3:GetObject",
+                                                         accountHolderTransport->s3Manager.selfPrincipal);
+    }
     
-    puttableUuids.push_back(this->address.initialFetchObjUuid);
+    // Start from the restored fetch position, if any
+    puttableUuids.push_back(fetchObjUuid);
     accountHolderTransport->s3Manager.makeObjPuttable(puttableUuids.back(), address);
     for (int idx = 0; idx < address.openObjects; ++idx) {
       puttableUuids.push_back(generateNextObjUuid(puttableUuids.back()));
       accountHolderTransport->s3Manager.makeObjPuttable(puttableUuids.back(), address);
     }
+    // The bucket policy was rebuilt from scratch, so grant access to the objects posted before the
+    // restart again
+    if (restoredCheckpoint.is_object()) {
+      for (auto &uuid : restoredCheckpoint.value("fetchable", std::vector<std::string>{})) {
+        fetchableUuids.push_back(uuid);
+        accountHolderTransport->s3Manager.makeObjGettable(uuid, address);
+      }
+    }
     logInfo("LinkAccountHolder constructed");
 }
 
@@ -66,94 +80,112 @@ LinkAccountHolder::~LinkAccountHolder() {
     shutdown();
 }
 
-std::string LinkAccountHolder::fetchOnActionThread(const std::string &fetchObjUuid) {
-    TRACE_METHOD(linkId, fetchObjUuid);
+bool LinkAccountHolder::fetchObject(const std::string &objUuid,
+                                    std::chrono::steady_clock::time_point deadline,
+                                    std::vector<uint8_t> &data) {
+    TRACE_METHOD(linkId, objUuid);
     logPrefix += linkId + ": ";
-    
-    std::vector<uint8_t> data;
-    if (accountHolderTransport->s3Manager.getObject(address.fetchBucket, fetchObjUuid, data)) { 
-        // Expand the "buffer" of puttable UUIDs by one, make it puttable
-        // Also pop the front of the buffer of UUIDs (which should be the one we just fetched) and make it unputtable
-        puttableUuids.push_back(generateNextObjUuid(puttableUuids.back()));
-        std::string toBeDropped = puttableUuids.front();
-        puttableUuids.pop_front();
-        if (toBeDropped != fetchObjUuid) {
-          logError(logPrefix + "front of puttableUuids (" + toBeDropped + ") was not the fetched object (" + fetchObjUuid + ") (popped anyway)");
-        }
-        accountHolderTransport->s3Manager.makeObjUnputtable(toBeDropped, address);
-        accountHolderTransport->s3Manager.makeObjPuttable(puttableUuids.back(), address);
-
-        logInfo(logPrefix + "data size: " + std::to_string(data.size()));
-        logInfo(logPrefix + "data: " + std::string(data.begin(), data.end()));
-
-       
-        sdk->onReceive(linkId, {linkId, "*/*", false, {}}, data);
+
+    if (cancelToken.isCancelled()) {
+        return false;
+    }
+    ObjectLocation location = fetchObjectLocation(address, objUuid);
+    if (not accountHolderTransport->s3Manager.getObject(location.bucket, location.key, data, cancelToken, deadline)) {
+        return false;
     }
+    logInfo(logPrefix + "data size: " + std::to_string(data.size()));
+    return true;
+}
+
+void LinkAccountHolder::releaseFetchedObject(const std::string &objUuid) {
+    TRACE_METHOD(linkId, objUuid);
+    logPrefix += linkId + ": ";
 
-    return puttableUuids.front();
+    // Expand the "buffer" of puttable UUIDs by one, make it puttable
+    // Also pop the front of the buffer of UUIDs (which should be the one we just fetched) and make it unputtable
+    puttableUuids.push_back(generateNextObjUuid(puttableUuids.back()));
+    std::string toBeDropped = puttableUuids.front();
+    puttableUuids.pop_front();
+    if (toBeDropped != objUuid) {
+      logError(logPrefix + "front of puttableUuids (" + toBeDropped + ") was not the fetched object (" + objUuid + ") (popped anyway)");
+    }
+    accountHolderTransport->s3Manager.makeObjUnputtable(toBeDropped, address);
+    accountHolderTransport->s3Manager.makeObjPuttable(puttableUuids.back(), address);
 }
 
-std::string LinkAccountHolder::postOnActionThread(const std::string &postObjUuid, const std::vector<RaceHandle> &handles, uint64_t actionId) {
-    TRACE_METHOD(linkId, handles, actionId);
+bool LinkAccountHolder::postOnActionThread(const std::string &postObjUuid, const ContentBuffer &content,
+                                           std::chrono::steady_clock::time_point deadline,
+                                           std::chrono::milliseconds &retryAfter) {
+    TRACE_METHOD(linkId, postObjUuid);
     logPrefix += linkId + ": ";
 
-    std::string nextPostObjUuid = postObjUuid;
-    auto iter = contentQueue.find(actionId);
-    if (iter == contentQueue.end()) {
-        logError(logPrefix +
-                 "no enqueued content for given action ID: " + std::to_string(actionId));
-        updatePackageStatus(handles, PACKAGE_FAILED_GENERIC);
-        return nextPostObjUuid;
+    if (cancelToken.isCancelled()) {
+        return false;
+    }
+    ObjectLocation location = postObjectLocation(address, postObjUuid);
+    if (not accountHolderTransport->s3Manager.putObject(location.bucket, location.key, content, retryAfter, cancelToken, deadline)) {
+        return false;
     }
 
-    int tries = 0;
-    for (; tries < address.maxTries; ++tries) {
-      if (accountHolderTransport->s3Manager.putObject(address.postBucket, postObjUuid, iter->second)) { 
-            break;
-        }
+    // Add GET permission for the posted UUID
+    // Remove GET permission from the oldest fetchable UUID
+    std::lock_guard<std::mutex> lock(fetchableMutex);
+    // Posts in flight at once complete out of order, so keep the fetchable UUIDs in chain order,
+    // the order the receiver reads them in, rather than completion order
+    auto position = fetchableUuids.end();
+    while (position != fetchableUuids.begin() and precedesInChain(postObjUuid, *std::prev(position))) {
+      --position;
     }
+    fetchableUuids.insert(position, postObjUuid);
+    accountHolderTransport->s3Manager.makeObjGettable(postObjUuid, address);
+
+    if (fetchableUuids.size() > static_cast<unsigned long>(address.openObjects)) {
+      std::string oldUuid = fetchableUuids.front();
+      fetchableUuids.pop_front();
+      logInfo(logPrefix + "popping old fetchable UUID: " + oldUuid);
+      accountHolderTransport->s3Manager.makeObjUngettable(oldUuid, address);
+    }
+    return true;
+}
 
-    if (tries == address.maxTries) {
-        logError(logPrefix + "retry limit exceeded: post failed");
-        updatePackageStatus(handles, PACKAGE_FAILED_GENERIC);
-    } else {
-      // Remove GET permission from the oldest fetchable UUID
-      // Add GET permission for a newly generated UUID
-      if (fetchableUuids.size() >= static_cast<unsigned long>(address.openObjects)) {
-        std::string oldUuid = fetchableUuids.front();
-        fetchableUuids.pop_front();
-        logInfo(logPrefix + "popping old fetchable UUID: " + oldUuid);
-        accountHolderTransport->s3Manager.makeObjUngettable(oldUuid, address);
+bool LinkAccountHolder::precedesInChain(const std::string &objUuid, const std::string &laterObjUuid) const {
+    // Fetchable objects are never further apart than the objects open at once plus the posts in
+    // flight, so only look that far ahead
+    std::string next = objUuid;
+    for (int idx = 0; idx < address.openObjects + postWindow; ++idx) {
+      next = generateNextObjUuid(next);
+      if (next == laterObjUuid) {
+        return true;
       }
-
-      fetchableUuids.push_back(postObjUuid);
-      accountHolderTransport->s3Manager.makeObjGettable(postObjUuid, address);
-
-      nextPostObjUuid = generateNextObjUuid(postObjUuid);
-      updatePackageStatus(handles, PACKAGE_SENT);
     }
-    return nextPostObjUuid;
+    return false;
+}
+
+nlohmann::json LinkAccountHolder::buildCheckpoint() {
+    nlohmann::json checkpoint = Link::buildCheckpoint();
+    std::lock_guard<std::mutex> lock(fetchableMutex);
+    checkpoint["fetchable"] = fetchableUuids;
+    return checkpoint;
 }
 
-void LinkAccountHolder::shutdown() {
+void LinkAccountHolder::releaseObjects() {
     TRACE_METHOD(linkId);
-    Link::shutdown();
+    RequestLedger::LinkScope ledgerScope(linkId);
     for (auto &uuid : puttableUuids) {
         accountHolderTransport->s3Manager.makeObjUnputtable(uuid, address);
     }
     std::thread cleanupFetchablesThread([uuidList = this->fetchableUuids,
                                          s3Manager = &this->accountHolderTransport->s3Manager,
                                          address = this->address]() {
+      // The link is gone by the time this runs, so don't bring its entry in the ledger back
+      RequestLedger::LinkScope ledgerScope(LEDGER_DESTROYED_LINK);
       std::this_thread::sleep_for(std::chrono::seconds(SHUTDOWN_DELAY_SECONDS));
       for (auto &uuid : uuidList) {
         s3Manager->makeObjUngettable(uuid, address);
       }
-      s3Manager->deleteBucket(address.fetchBucket, address.region);
-      logInfo("fetchBucket == postBucket " + std::to_string(address.fetchBucket.compare(address.postBucket)));
-      logInfo(address.fetchBucket + " " + address.postBucket);
-      if (address.fetchBucket.compare(address.postBucket) != 0) {
-        logInfo("deleting postBucket");
-        s3Manager->deleteBucket(address.postBucket, address.region);
+      for (auto &bucket : linkBuckets(address)) {
+        logInfo("deleting bucket " + bucket);
+        s3Manager->deleteBucket(bucket, address.region);
       }
     });
     cleanupFetchablesThread.detach();
@@ -49,16 +49,34 @@ public:
 
     virtual ~LinkAccountHolder();
 
+    virtual void releaseObjects() override;
+
 protected:
-    virtual std::string fetchOnActionThread(const std::string &fetchObjUuid) override; 
-    virtual std::string postOnActionThread(const std::string &postObjUuid, const std::vector<RaceHandle> &handles, uint64_t actionId) override;
-    virtual void shutdown() override;
+    virtual bool fetchObject(const std::string &objUuid,
+                             std::chrono::steady_clock::time_point deadline,
+                             std::vector<uint8_t> &data) override;
+    virtual void releaseFetchedObject(const std::string &objUuid) override;
+    virtual bool postOnActionThread(const std::string &postObjUuid, const ContentBuffer &content,
+                                    std::chrono::steady_clock::time_point deadline,
+                                    std::chrono::milliseconds &retryAfter) override;
+    virtual nlohmann::json buildCheckpoint() override;
+
+    /**
+     * @brief Check whether an object comes before another one in the post chain, within the
+     * objects that can be fetchable at once.
+     *
+     * @param objUuid UUID of the object
+     * @param laterObjUuid UUID of the object that may come after it
+     * @return true if laterObjUuid follows objUuid in the chain
+     */
+    bool precedesInChain(const std::string &objUuid, const std::string &laterObjUuid) const;
 
     bool creator;
     SkyhookTransportAccountHolder *accountHolderTransport;
 
   std::deque<std::string> puttableUuids; // objects publicly writable
-  std::deque<std::string> fetchableUuids; // objects publicy readable
+  std::deque<std::string> fetchableUuids; // objects publicy readable, in chain order
+  std::mutex fetchableMutex; // posts in flight at once complete concurrently
 };
 
 #endif  //  __COMMS_TWOSIX_TRANSPORT_LINK_ACCOUNT_HOLDER_H__
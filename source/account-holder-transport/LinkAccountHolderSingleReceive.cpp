@@ -53,28 +53,28 @@ LinkAccountHolderSingleReceive::~LinkAccountHolderSingleReceive() {
     shutdown();
 }
 
-std::string LinkAccountHolderSingleReceive::fetchOnActionThread(const std::string &fetchObjUuid) {
+std::string LinkAccountHolderSingleReceive::fetchOnActionThread(const std::string &fetchObjUuid,
+                                                                std::chrono::steady_clock::time_point deadline) {
     TRACE_METHOD(linkId, fetchObjUuid);
     logPrefix += linkId + ": ";
     
     std::vector<uint8_t> data;
-    if (accountHolderTransport->s3Manager.getObject(address.fetchBucket, fetchObjUuid, data)) {
+    ObjectLocation location = fetchObjectLocation(address, fetchObjUuid);
+    if (accountHolderTransport->s3Manager.getObject(location.bucket, location.key, data, cancelToken, deadline)) {
         logInfo(logPrefix + "data size: " + std::to_string(data.size()));
-        logInfo(logPrefix + "data: " + std::string(data.begin(), data.end()));
-        sdk->onReceive(linkId, {linkId, "*/*", false, {}}, data);
-        accountHolderTransport->s3Manager.deleteObject(address.fetchBucket, fetchObjUuid);
+        logInfo(logPrefix + "data: " + describePayload(data));
+        deliverReceived(fetchObjUuid, data);
+        accountHolderTransport->s3Manager.deleteObject(location.bucket, location.key);
     }
 
     return puttableUuids.front();
 }
 
-std::string LinkAccountHolderSingleReceive::postOnActionThread(const std::string &postObjUuid, const std::vector<RaceHandle> &handles, uint64_t actionId) {
+ComponentStatus LinkAccountHolderSingleReceive::post(std::vector<RaceHandle> handles, uint64_t actionId) {
     TRACE_METHOD(linkId, handles, actionId);
     logPrefix += linkId + ": ";
     logError(logPrefix + "No sending allowed on a SingleReceive link");
+    dequeueContent(actionId);
     updatePackageStatus(handles, PACKAGE_FAILED_GENERIC);
-    return postObjUuid;
+    return COMPONENT_OK;
 }
-
-
-
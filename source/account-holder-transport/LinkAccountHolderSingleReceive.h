@@ -47,9 +47,11 @@ public:
 
     virtual ~LinkAccountHolderSingleReceive();
 
+    virtual ComponentStatus post(std::vector<RaceHandle> handles, uint64_t actionId) override;
+
 protected:
-    virtual std::string fetchOnActionThread(const std::string &fetchObjUuid) override; 
-    virtual std::string postOnActionThread(const std::string &postObjUuid, const std::vector<RaceHandle> &handles, uint64_t actionId) override;
+    virtual std::string fetchOnActionThread(const std::string &fetchObjUuid,
+                                            std::chrono::steady_clock::time_point deadline) override;
 };
 
 #endif  //  __COMMS_TWOSIX_TRANSPORT_LINK_ACCOUNT_HOLDER_SINGLE_RECEIVE_H__
@@ -17,11 +17,17 @@
 
 #include "S3Manager.h"
 
+#include <functional>
 #include <iostream>
+#include "RetryBackoff.h"
+#include "Tracing.h"
 #include "log.h"
 #include <nlohmann/json.hpp>
 #include <aws/core/VersionConfig.h>
 #include <aws/core/Aws.h>
+#include <aws/core/http/HttpRequest.h>
+#include <aws/core/http/HttpResponse.h>
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include <aws/s3/S3ClientConfiguration.h>
 #include <aws/s3/S3Client.h>
 #include <aws/s3/model/AccessControlPolicy.h>
@@ -41,7 +47,47 @@
 #define PRIVATE_GETTABLE_STRING "private-gettable-"
 
 
-S3Manager::S3Manager() : policyJsonMap() {}
+/**
+ * @brief Create a handler that lets a request continue until it is cancelled or overruns its
+ * deadline
+ */
+static std::function<bool(const Aws::Http::HttpRequest *)> continueUntil(
+    const CancellationToken &cancelToken, std::chrono::steady_clock::time_point deadline) {
+  return [&cancelToken, deadline](const Aws::Http::HttpRequest *) {
+    return not cancelToken.isCancelled() and std::chrono::steady_clock::now() < deadline;
+  };
+}
+
+/**
+ * @brief Get the configuration of the S3 client, pointed at the endpoint override if one is set.
+ * Endpoints other than AWS are addressed path-style since they generally don't have per-bucket
+ * host names.
+ */
+static Aws::S3::S3ClientConfiguration clientConfiguration() {
+  Aws::S3::S3ClientConfiguration config;
+  std::string endpoint = s3EndpointOverride();
+  if (not endpoint.empty()) {
+    logInfo("S3Manager: using endpoint " + endpoint);
+    config.endpointOverride = endpoint;
+    config.scheme = endpoint.rfind("http://", 0) == 0 ? Aws::Http::Scheme::HTTP : Aws::Http::Scheme::HTTPS;
+    config.useVirtualAddressing = false;
+  }
+  return config;
+}
+
+S3Manager::S3Manager(MetricsRegistry &metrics, RequestLedger &ledger) :
+  policyJsonMap(),
+  getCount(metrics.counter("s3_get_count")),
+  getErrorCount(metrics.counter("s3_get_error_count")),
+  putCount(metrics.counter("s3_put_count")),
+  putErrorCount(metrics.counter("s3_put_error_count")),
+  policyWriteCount(metrics.counter("s3_policy_write_count")),
+  policyWriteErrorCount(metrics.counter("s3_policy_write_error_count")),
+  getLatency(metrics.histogram("s3_get_latency_us")),
+  putLatency(metrics.histogram("s3_put_latency_us")),
+  policyWriteLatency(metrics.histogram("s3_policy_write_latency_us")),
+  ledger(ledger),
+  s3Client(clientConfiguration()) {}
 //   policyJsonMap({ {"Version", "2012-10-17"}, {"Id", "RacebucketPolicy"}, {"Statement", {
 //   }} }) {
 // }
@@ -93,13 +139,16 @@ bool S3Manager::addObjPermission(const std::string &uuid,
 
 bool S3Manager::makeObjGettable(const std::string &uuid, const LinkAddress &address) {
   TRACE_METHOD(uuid, address);
-  return addObjPermission(uuid, address.postBucket, PUBLIC_GETTABLE_STRING + address.initialPostObjUuid, "s3:GetObject", "*");
+  ObjectLocation location = postObjectLocation(address, uuid);
+  return addObjPermission(location.key, location.bucket, PUBLIC_GETTABLE_STRING + address.initialPostObjUuid, "s3:GetObject", "*");
 }
 
 bool S3Manager::makeObjPuttable(const std::string &uuid, const LinkAddress &address) {
   TRACE_METHOD(uuid, address);
-  return (deleteObject(address.postBucket, uuid) and
-          addObjPermission(uuid, address.postBucket,
+  // Puttable objects are the ones this end fetches
+  ObjectLocation location = fetchObjectLocation(address, uuid);
+  return (deleteObject(location.bucket, location.key) and
+          addObjPermission(location.key, location.bucket,
                            PUBLIC_PUTTABLE_STRING + address.initialFetchObjUuid, "s3:PutObject", "*"));
 }
 
@@ -142,16 +191,18 @@ bool S3Manager::removeObjPermission(const std::string &uuid,
 bool S3Manager::makeObjUngettable(const std::string &uuid, const LinkAddress &address) {
   TRACE_METHOD(uuid, address);
   const std::string statementKey = PUBLIC_GETTABLE_STRING + address.initialPostObjUuid;
-  return (deleteObject(address.postBucket, uuid) and
-          removeObjPermission(uuid, address.postBucket, statementKey));
+  ObjectLocation location = postObjectLocation(address, uuid);
+  return (deleteObject(location.bucket, location.key) and
+          removeObjPermission(location.key, location.bucket, statementKey));
 }
 
 bool S3Manager::makeObjUnputtable(const std::string &uuid, const LinkAddress &address) {
   TRACE_METHOD(uuid, address);
   const std::string statementKey = PUBLIC_PUTTABLE_STRING + address.initialFetchObjUuid;
 
-  return (deleteObject(address.fetchBucket, uuid) and
-          removeObjPermission(uuid, address.fetchBucket, statementKey));
+  ObjectLocation location = fetchObjectLocation(address, uuid);
+  return (deleteObject(location.bucket, location.key) and
+          removeObjPermission(location.key, location.bucket, statementKey));
 }
 
 
@@ -187,6 +238,7 @@ bool S3Manager::createBucket(const std::string &bucketName, const std::string &r
     }
     request.SetCreateBucketConfiguration(createBucketConfig);
 
+    ledger.record(S3_REQUEST_BUCKET_WRITE, bucketName);
     Aws::S3::Model::CreateBucketOutcome outcome = s3Client.CreateBucket(request);
     if (!outcome.IsSuccess()) {
         auto err = outcome.GetError();
@@ -195,6 +247,7 @@ bool S3Manager::createBucket(const std::string &bucketName, const std::string &r
     else {
       logInfo("Created bucket " + bucketName + " in the specified AWS Region.");
       Aws::S3::Model::PutPublicAccessBlockRequest pabRequest = Aws::S3::Model::PutPublicAccessBlockRequest().WithPublicAccessBlockConfiguration(Aws::S3::Model::PublicAccessBlockConfiguration().WithBlockPublicAcls(false)).WithBucket(bucketName);
+      ledger.record(S3_REQUEST_BUCKET_WRITE, bucketName);
       Aws::S3::Model::PutPublicAccessBlockOutcome pabOutcome = s3Client.PutPublicAccessBlock(pabRequest);
       if (!pabOutcome.IsSuccess()) {
         auto err = outcome.GetError();
@@ -205,7 +258,9 @@ bool S3Manager::createBucket(const std::string &bucketName, const std::string &r
       }
     }
     
-    policyJsonMap[bucketName] = { {"Version", "2012-10-17"}, {"Id", "RacebucketPolicy"}, {"Statement", {}}};
+    // Every link creates its buckets, so keep the statements of the links already using them
+    std::lock_guard<std::mutex> lock{policyLock};
+    policyJsonMap.emplace(bucketName, nlohmann::json{ {"Version", "2012-10-17"}, {"Id", "RacebucketPolicy"}, {"Statement", {}}});
     return outcome.IsSuccess();
 }
 
@@ -222,6 +277,7 @@ bool S3Manager::deleteBucket(const std::string &bucketName, const std::string &r
     // }
     // request.SetDeleteBucketConfiguration(deleteBucketConfig);
 
+    ledger.record(S3_REQUEST_DELETE_BUCKET, bucketName);
     Aws::S3::Model::DeleteBucketOutcome outcome = s3Client.DeleteBucket(request);
     if (!outcome.IsSuccess()) {
         auto err = outcome.GetError();
@@ -247,10 +303,16 @@ bool S3Manager::updatePolicy(const std::string &bucketName) {
   request.SetBody(request_body);
   logInfo("updating to: " + bucketName);
   
+  TraceSpan span("s3_policy_update", "policy");
+  auto start = std::chrono::steady_clock::now();
   Aws::S3::Model::PutBucketPolicyOutcome outcome =
     s3Client.PutBucketPolicy(request);
+  policyWriteLatency.recordSince(start);
+  policyWriteCount.add();
+  ledger.record(S3_REQUEST_POLICY_WRITE, bucketName);
   
     if (!outcome.IsSuccess()) {
+      policyWriteErrorCount.add();
       const Aws::S3::S3Error &err = outcome.GetError();
       logError("Error: PutBucketPolicyRequest: "
                + err.GetExceptionName() + ": " + err.GetMessage());
@@ -261,16 +323,25 @@ bool S3Manager::updatePolicy(const std::string &bucketName) {
 
 bool S3Manager::getObject(const std::string &bucketName,
                           const std::string &objectUuid,
-                          std::vector<uint8_t> &data) {
+                          std::vector<uint8_t> &data,
+                          const CancellationToken &cancelToken,
+                          std::chrono::steady_clock::time_point deadline) {
   TRACE_METHOD(bucketName, objectUuid);
 
     Aws::S3::Model::GetObjectRequest request;
     request.SetBucket(bucketName);
     request.SetKey(objectUuid);
+    request.SetContinueRequestHandler(continueUntil(cancelToken, deadline));
 
+    TraceSpan span("s3_get", "network");
+    auto start = std::chrono::steady_clock::now();
     Aws::S3::Model::GetObjectOutcome outcome = s3Client.GetObject(request);
+    getLatency.recordSince(start);
+    getCount.add();
+    ledger.record(S3_REQUEST_GET, bucketName);
 
     if (!outcome.IsSuccess()) {
+        getErrorCount.add();
         const Aws::S3::S3Error &err = outcome.GetError();
         logInfo("Error: GetObject(" + bucketName + "/" + objectUuid + "): " + 
                  err.GetExceptionName() + ": " + err.GetMessage());
@@ -288,7 +359,7 @@ bool S3Manager::getObject(const std::string &bucketName,
 
         std::string str = ss.str();
         std::copy(str.begin(), str.end(), std::back_inserter(data));
-        logInfo("Retrieved Data: " + std::string(data.begin(), data.end()));
+        logInfo("Retrieved Data: " + describePayload(data));
        
         return true;
     }
@@ -302,6 +373,8 @@ bool S3Manager::deleteObject(const std::string &bucketName,
     request.SetBucket(bucketName);
     request.SetKey(objectUuid);
 
+    TraceSpan span("s3_delete", "network");
+    ledger.record(S3_REQUEST_DELETE_OBJECT, bucketName);
     Aws::S3::Model::DeleteObjectOutcome outcome = s3Client.DeleteObject(request);
 
     if (!outcome.IsSuccess()) {
@@ -318,23 +391,43 @@ bool S3Manager::deleteObject(const std::string &bucketName,
 
 bool S3Manager::putObject(const std::string &bucketName,
                           const std::string &objectUuid,
-                          std::vector<uint8_t> &data) {
+                          const ContentBuffer &content,
+                          std::chrono::milliseconds &retryAfter,
+                          const CancellationToken &cancelToken,
+                          std::chrono::steady_clock::time_point deadline) {
   TRACE_METHOD(bucketName, objectUuid);
 
-  logInfo("Data to be posted: " + std::string(data.begin(), data.end()));
+  logInfo("Putting object of size: " + std::to_string(content->size()));
   Aws::S3::Model::PutObjectRequest request;
   request.SetBucket(bucketName);
   request.SetKey(objectUuid);
-  // std::shared_ptr<std::stringstream> input_data = std::make_shared<std::stringstream>(reinterpret_cast<const char*>(data.data()));
-  std::shared_ptr<std::stringstream> input_data = std::make_shared<std::stringstream>(std::string(data.begin(), data.end()));
-  logInfo("Putting object: " + input_data->str());
-  request.SetBody(input_data);
-
+  // Stream the body straight out of the content buffer. The stream buffer only reads from the
+  // content, and PutObject is synchronous, so it doesn't outlive the content.
+  Aws::Utils::Stream::PreallocatedStreamBuf streamBuf(const_cast<unsigned char *>(content->data()),
+                                                      content->size());
+  request.SetBody(Aws::MakeShared<Aws::IOStream>("S3Manager", &streamBuf));
+  request.SetContentLength(static_cast<long long>(content->size()));
+  request.SetContinueRequestHandler(continueUntil(cancelToken, deadline));
+
+  TraceSpan span("s3_put", "network");
+  auto start = std::chrono::steady_clock::now();
   Aws::S3::Model::PutObjectOutcome outcome =
     s3Client.PutObject(request);
+  putLatency.recordSince(start);
+  putCount.add();
+  ledger.record(S3_REQUEST_PUT, bucketName);
 
   if (!outcome.IsSuccess()) {
-    logError("Error: PutObject: " + outcome.GetError().GetMessage());
+    putErrorCount.add();
+    const Aws::S3::S3Error &err = outcome.GetError();
+    logError("Error: PutObject: " + err.GetExceptionName() + ": " + err.GetMessage());
+    if (err.GetResponseCode() == Aws::Http::HttpResponseCode::SERVICE_UNAVAILABLE or
+        err.GetExceptionName() == "SlowDown") {
+      // S3 is throttling us, back off for at least as long as it asks
+      const auto &headers = err.GetResponseHeaders();
+      auto header = headers.find("retry-after");
+      retryAfter = RetryBackoff::parseRetryAfter(header != headers.end() ? header->second : "");
+    }
     return false;
   }
   return true;
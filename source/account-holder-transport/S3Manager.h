@@ -19,16 +19,21 @@
 #define __S3_MANAGER_H__
 
 #include <atomic>
+#include <chrono>
 #include <aws/core/VersionConfig.h>
 #include <aws/core/Aws.h>
 #include <aws/s3/S3Client.h>
+#include "CancellationToken.h"
+#include "ContentBuffer.h"
 #include "LinkAddress.h"
+#include "Metrics.h"
+#include "RequestLedger.h"
 #include <nlohmann/json.hpp>
 #include <mutex>          // std::mutex, std::lock_guard
 
 class S3Manager {
 public:
-  S3Manager();
+  S3Manager(MetricsRegistry &metrics, RequestLedger &ledger);
   virtual ~S3Manager() {
       // Aws::ShutdownAPI(options);
   }
@@ -47,19 +52,36 @@ public:
   // virtual bool GetBucketPolicy(const std::string &bucketName);
   virtual bool getObject(const std::string &bucketName,
                           const std::string &objectUuid,
-                         std::vector<uint8_t> &data);
+                         std::vector<uint8_t> &data,
+                         const CancellationToken &cancelToken,
+                         std::chrono::steady_clock::time_point deadline);
   virtual bool deleteObject(const std::string &bucketName,
                              const std::string &objectUuid);
   virtual bool putObject(const std::string &bucketName,
                           const std::string &objectUuid,
-                          std::vector<uint8_t> &data);
+                          const ContentBuffer &content,
+                          std::chrono::milliseconds &retryAfter,
+                          const CancellationToken &cancelToken,
+                          std::chrono::steady_clock::time_point deadline);
 
 
   std::string selfPrincipal;
-private:
+protected:
+  // Protected so that the policy bookkeeping can be exercised without talking to S3
   virtual bool updatePolicy(const std::string &bucket);
   
   std::unordered_map<std::string, nlohmann::json> policyJsonMap;
+private:
+  Counter &getCount;
+  Counter &getErrorCount;
+  Counter &putCount;
+  Counter &putErrorCount;
+  Counter &policyWriteCount;
+  Counter &policyWriteErrorCount;
+  Histogram &getLatency;
+  Histogram &putLatency;
+  Histogram &policyWriteLatency;
+  RequestLedger &ledger;
   Aws::S3::S3Client s3Client;
   std::mutex policyLock;
 };
@@ -41,9 +41,17 @@
 
 SkyhookTransportAccountHolder::SkyhookTransportAccountHolder(ITransportSdk *sdk, const std::string &roleName) :
   SkyhookTransport(sdk, roleName),
+  s3Manager(metrics, requestLedger),
   canonicalIdReqHandle(sdk->requestPluginUserInput("canonicalId", "What is the Canonical ID for your AWS S3 account? (https://docs.aws.amazon.com/accounts/latest/reference/manage-acct-identifiers.html#FindingCanonicalId)", true).handle) {
 }
 
+SkyhookTransportAccountHolder::~SkyhookTransportAccountHolder() {
+    TRACE_METHOD();
+    // Shut the links down while the S3 manager their threads use is still there. They keep their
+    // objects and buckets, to carry on from their checkpoints when they are restored.
+    links.clear();
+}
+
 ComponentStatus SkyhookTransportAccountHolder::onUserInputReceived(RaceHandle handle, bool answered,
                                                                    const std::string &response) {
     TRACE_METHOD(handle, answered, response);
@@ -60,7 +68,10 @@ ComponentStatus SkyhookTransportAccountHolder::onUserInputReceived(RaceHandle ha
       SkyhookTransport::handleUserInputResponse(handle, answered, response);
     }
 
-    if (canonicalIdReqHandle == NULL_RACE_HANDLE and
+    // Tuning knobs such as maxQueuedBytes, traceSampleRate, and logLevel keep their defaults until
+    // answered, so they don't hold up starting
+    if (not ready and
+        canonicalIdReqHandle == NULL_RACE_HANDLE and
         regionReqHandle == NULL_RACE_HANDLE and
         bucketReqHandle == NULL_RACE_HANDLE and
         seedReqHandle == NULL_RACE_HANDLE and
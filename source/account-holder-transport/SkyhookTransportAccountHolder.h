@@ -36,6 +36,8 @@ class SkyhookTransportAccountHolder : public SkyhookTransport {
 public:
     explicit SkyhookTransportAccountHolder(ITransportSdk *sdk, const std::string &roleName);
 
+    virtual ~SkyhookTransportAccountHolder();
+
     virtual ComponentStatus onUserInputReceived(RaceHandle handle, bool answered,
                                                 const std::string &response) override;
     S3Manager s3Manager;
@@ -0,0 +1,188 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <benchmark/benchmark.h>
+
+#include <aws/core/Aws.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CurlCallbacks.h"
+#include "JsonTypes.h"
+#include "Link.h"
+#include "LinkAddress.h"
+#include "MockUserModelSdk.h"
+#include "S3Manager.h"
+#include "SkyhookBaseUserModel.h"
+#include "log.h"
+
+// Realistic sizes: an account holder keeps openObjects puttable and gettable objects per link,
+// and a bucket policy holds one statement per link
+static const int OPEN_OBJECTS = 10;
+static const std::string BUCKET = "skyhook-benchmark-bucket";
+
+/**
+ * @brief S3 manager that keeps the policy bookkeeping but never writes the policy to S3
+ */
+class OfflineS3Manager : public S3Manager {
+public:
+    OfflineS3Manager(MetricsRegistry &metrics, RequestLedger &ledger) : S3Manager(metrics, ledger) {
+        policyJsonMap[BUCKET] = {
+            {"Version", "2012-10-17"}, {"Id", "RacebucketPolicy"}, {"Statement", {}}};
+    }
+
+private:
+    bool updatePolicy(const std::string &bucket) override {
+        // Serializing the policy is part of the cost of every update
+        benchmark::DoNotOptimize(policyJsonMap.at(bucket).dump());
+        return true;
+    }
+};
+
+static void BM_GenerateNextObjUuid(benchmark::State &state) {
+    std::string uuid = "initial-object-uuid";
+    for (auto _ : state) {
+        uuid = Link::generateNextObjUuid(uuid);
+        benchmark::DoNotOptimize(uuid);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenerateNextObjUuid);
+
+// Rotate one object of a link's window while the policy holds the given number of links
+static void BM_S3ManagerPolicyRotate(benchmark::State &state) {
+    MetricsRegistry metrics;
+    RequestLedger ledger;
+    OfflineS3Manager s3Manager(metrics, ledger);
+    const int links = static_cast<int>(state.range(0));
+
+    std::vector<std::string> uuids;
+    for (int link = 0; link < links; ++link) {
+        std::string uuid = "link-" + std::to_string(link);
+        for (int i = 0; i < OPEN_OBJECTS; ++i) {
+            uuid = Link::generateNextObjUuid(uuid);
+            s3Manager.addObjPermission(uuid, BUCKET, "statement-" + std::to_string(link),
+                                       "s3:GetObject", "*");
+        }
+        uuids.push_back(uuid);
+    }
+
+    // Rotate the window of the last link, the worst case for finding its statement
+    std::string statementKey = "statement-" + std::to_string(links - 1);
+    std::string oldest = "link-" + std::to_string(links - 1);
+    oldest = Link::generateNextObjUuid(oldest);
+    std::string newest = uuids.back();
+    for (auto _ : state) {
+        newest = Link::generateNextObjUuid(newest);
+        s3Manager.addObjPermission(newest, BUCKET, statementKey, "s3:GetObject", "*");
+        s3Manager.removeObjPermission(oldest, BUCKET, statementKey);
+        oldest = Link::generateNextObjUuid(oldest);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_S3ManagerPolicyRotate)->RangeMultiplier(10)->Range(1, 1000);
+
+// Generate each timeline fetch period's worth of timeline, as the framework does
+static void BM_GetTimeline(benchmark::State &state) {
+    MockUserModelSdk sdk(mockSkyhookChannelProperties());
+    SkyhookBaseUserModel userModel(&sdk);
+    const int links = static_cast<int>(state.range(0));
+    for (int link = 0; link < links; ++link) {
+        userModel.addLink("link-" + std::to_string(link), {""});
+    }
+
+    UserModelProperties properties = userModel.getUserModelProperties();
+    Timestamp start = std::chrono::duration<double>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    size_t actions = 0;
+    for (auto _ : state) {
+        ActionTimeline timeline =
+            userModel.getTimeline(start, start + properties.timelineLength);
+        actions += timeline.size();
+        benchmark::DoNotOptimize(timeline);
+        start += properties.timelineFetchPeriod;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(actions));
+}
+BENCHMARK(BM_GetTimeline)->RangeMultiplier(10)->Range(10, 1000)->Unit(benchmark::kMillisecond);
+
+// The first thing doAction does with every action
+static void BM_ParseActionJson(benchmark::State &state) {
+    Action action{0, 1, nlohmann::json(ActionJson{"link-0", ACTION_FETCH}).dump()};
+    for (auto _ : state) {
+        ActionJson actionParams = nlohmann::json::parse(action.json);
+        benchmark::DoNotOptimize(actionParams);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseActionJson);
+
+// Receive a fetched object through the curl write callback, in typical curl-sized chunks, and
+// copy it into the buffer handed to the SDK
+static void BM_ReceiveBuffer(benchmark::State &state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    const size_t chunkSize = 16 * 1024;
+    std::vector<char> object(size, 'x');
+    for (auto _ : state) {
+        std::string response;
+        for (size_t offset = 0; offset < size; offset += chunkSize) {
+            WriteCallback(object.data() + offset, 1, std::min(chunkSize, size - offset), &response);
+        }
+        std::vector<uint8_t> data(response.begin(), response.end());
+        benchmark::DoNotOptimize(data);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_ReceiveBuffer)->RangeMultiplier(16)->Range(256, 4 * 1024 * 1024);
+
+// Stream posted content out through the curl read callback
+static void BM_SendBuffer(benchmark::State &state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    const size_t chunkSize = 16 * 1024;
+    ContentBuffer content = makeContentBuffer(std::vector<uint8_t>(size, 'x'));
+    std::vector<char> chunk(chunkSize);
+    for (auto _ : state) {
+        inc_copy_vec upload{0, content};
+        while (read_callback(chunk.data(), 1, chunkSize, &upload) > 0) {
+            benchmark::ClobberMemory();
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_SendBuffer)->RangeMultiplier(16)->Range(256, 4 * 1024 * 1024);
+
+int main(int argc, char **argv) {
+    // Measure the code, not the logging
+    setLogLevel(SKYHOOK_LOG_LEVEL_ERROR);
+
+    Aws::SDKOptions options;
+    Aws::InitAPI(options);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    Aws::ShutdownAPI(options);
+    return 0;
+}
@@ -0,0 +1,40 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_CANCELLATION_TOKEN_H__
+#define __SKYHOOK_TRANSPORT_CANCELLATION_TOKEN_H__
+
+#include <atomic>
+
+/**
+ * @brief Cooperative cancellation flag for in-flight transfers. Transfers poll the token and
+ * abort once it has been cancelled. This class is thread-safe.
+ */
+class CancellationToken {
+public:
+    void cancel() {
+        cancelled = true;
+    }
+
+    bool isCancelled() const {
+        return cancelled;
+    }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+#endif  // __SKYHOOK_TRANSPORT_CANCELLATION_TOKEN_H__
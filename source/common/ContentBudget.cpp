@@ -0,0 +1,120 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "ContentBudget.h"
+
+#include "log.h"
+
+// Fractions of the total budget
+static const double LINK_QUOTA_FRACTION = 0.25;
+static const double HIGH_WATERMARK_FRACTION = 0.9;
+static const double LOW_WATERMARK_FRACTION = 0.75;
+
+ContentBudget::ContentBudget(size_t limitBytes) {
+    setLimit(limitBytes);
+}
+
+void ContentBudget::setLimit(size_t limitBytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    limit = limitBytes;
+    linkQuota = static_cast<size_t>(limit * LINK_QUOTA_FRACTION);
+    highWatermark = static_cast<size_t>(limit * HIGH_WATERMARK_FRACTION);
+    lowWatermark = static_cast<size_t>(limit * LOW_WATERMARK_FRACTION);
+    logInfo("ContentBudget: limit: " + std::to_string(limit) +
+            ", link quota: " + std::to_string(linkQuota));
+}
+
+ContentBuffer ContentBudget::allocate(const LinkID &linkId, const std::vector<uint8_t> &content) {
+    if (not reserve(linkId, content.size())) {
+        return nullptr;
+    }
+
+    size_t bytes = content.size();
+    return ContentBuffer(new std::vector<uint8_t>(content),
+                         [this, linkId, bytes](const std::vector<uint8_t> *buffer) {
+                             delete buffer;
+                             release(linkId, bytes);
+                         });
+}
+
+bool ContentBudget::reserve(const LinkID &linkId, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = linkUsage.find(linkId);
+    size_t linkBytes = iter == linkUsage.end() ? 0 : iter->second;
+
+    if (throttled or usage + bytes > limit) {
+        logWarning("ContentBudget: refusing " + std::to_string(bytes) + " bytes for link " +
+                   linkId + ", usage: " + std::to_string(usage) + "/" + std::to_string(limit));
+        return false;
+    }
+    // Always let a link queue at least one message, even if it is larger than the quota, so that
+    // large messages aren't refused forever
+    if (linkBytes > 0 and linkBytes + bytes > linkQuota) {
+        logWarning("ContentBudget: refusing " + std::to_string(bytes) + " bytes for link " +
+                   linkId + ", link usage: " + std::to_string(linkBytes) + "/" +
+                   std::to_string(linkQuota));
+        return false;
+    }
+
+    linkUsage[linkId] += bytes;
+    usage += bytes;
+    if (usage > highWatermark) {
+        throttled = true;
+        logWarning("ContentBudget: usage " + std::to_string(usage) +
+                   " crossed high watermark, refusing content until it drains below " +
+                   std::to_string(lowWatermark));
+    }
+    return true;
+}
+
+void ContentBudget::release(const LinkID &linkId, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    usage -= bytes;
+    auto iter = linkUsage.find(linkId);
+    if (iter != linkUsage.end()) {
+        iter->second -= bytes;
+        if (iter->second == 0) {
+            linkUsage.erase(iter);
+        }
+    }
+
+    if (throttled and usage <= lowWatermark) {
+        throttled = false;
+        logInfo("ContentBudget: usage " + std::to_string(usage) +
+                " drained below low watermark, accepting content again");
+    }
+}
+
+size_t ContentBudget::getLimit() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return limit;
+}
+
+size_t ContentBudget::getUsage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usage;
+}
+
+size_t ContentBudget::getLinkUsage(const LinkID &linkId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = linkUsage.find(linkId);
+    return iter == linkUsage.end() ? 0 : iter->second;
+}
+
+bool ContentBudget::isThrottled() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return throttled;
+}
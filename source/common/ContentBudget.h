@@ -0,0 +1,76 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_CONTENT_BUDGET_H__
+#define __SKYHOOK_TRANSPORT_CONTENT_BUDGET_H__
+
+#include <ComponentTypes.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include "ContentBuffer.h"
+
+const size_t DEFAULT_CONTENT_BUDGET_BYTES = 64 * 1024 * 1024;
+
+/**
+ * @brief Transport-wide accounting of the memory held by queued outbound content. Content is
+ * refused once the budget, or the quota of the link it belongs to, would be exceeded. Once usage
+ * crosses the high watermark all new content is refused until usage drains below the low
+ * watermark. This function is thread-safe.
+ */
+class ContentBudget {
+public:
+    explicit ContentBudget(size_t limitBytes = DEFAULT_CONTENT_BUDGET_BYTES);
+
+    /**
+     * @brief Set the total number of bytes that may be queued across all links. The per-link
+     * quota and watermarks are derived from it.
+     *
+     * @param limitBytes Budget in bytes
+     */
+    void setLimit(size_t limitBytes);
+
+    /**
+     * @brief Copy the given content into a buffer charged against the budget. The charge is
+     * released when the last reference to the buffer is dropped.
+     *
+     * @param linkId ID of the link the content is queued on
+     * @param content Content to be queued
+     * @return The content buffer, or nullptr if the content does not fit in the budget
+     */
+    ContentBuffer allocate(const LinkID &linkId, const std::vector<uint8_t> &content);
+
+    size_t getLimit() const;
+    size_t getUsage() const;
+    size_t getLinkUsage(const LinkID &linkId) const;
+    bool isThrottled() const;
+
+private:
+    bool reserve(const LinkID &linkId, size_t bytes);
+    void release(const LinkID &linkId, size_t bytes);
+
+    mutable std::mutex mutex;
+    size_t limit;
+    size_t linkQuota;
+    size_t highWatermark;
+    size_t lowWatermark;
+    size_t usage{0};
+    bool throttled{false};
+    std::unordered_map<LinkID, size_t> linkUsage;
+};
+
+#endif  // __SKYHOOK_TRANSPORT_CONTENT_BUDGET_H__
@@ -0,0 +1,41 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_CONTENT_BUFFER_H__
+#define __SKYHOOK_TRANSPORT_CONTENT_BUFFER_H__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Immutable, reference-counted content of a post action. The buffer is handed along the
+ * send path by moving the reference, so the bytes are never copied after they are enqueued. The
+ * bytes are freed as soon as the last reference is dropped.
+ */
+using ContentBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+/**
+ * @brief Create a content buffer taking ownership of the given bytes.
+ *
+ * @param content Bytes to be wrapped
+ * @return The content buffer
+ */
+inline ContentBuffer makeContentBuffer(std::vector<uint8_t> content) {
+    return std::make_shared<const std::vector<uint8_t>>(std::move(content));
+}
+
+#endif  // __SKYHOOK_TRANSPORT_CONTENT_BUFFER_H__
@@ -0,0 +1,46 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __SKYHOOK_TRANSPORT_CURL_CALLBACKS_H__
+#define __SKYHOOK_TRANSPORT_CURL_CALLBACKS_H__
+
+#include <cstddef>
+
+#include "ContentBuffer.h"
+
+/**
+ * @brief callback function required by libcurl-dev, appends the received bytes to the
+ * std::string pointed to by userp.
+ * See documentation in link below:
+ * https://curl.haxx.se/libcurl/c/libcurl-tutorial.html
+ */
+size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp);
+
+/**
+ * @brief State of a read_callback upload: the content and how much of it has been sent.
+ */
+struct inc_copy_vec {
+    size_t current_offset;
+    ContentBuffer content;
+};
+
+/**
+ * @brief callback function required by libcurl-dev, copies the next chunk of the content into
+ * the upload buffer.
+ */
+size_t read_callback(char *ptr, size_t size, size_t nmemb, inc_copy_vec *userdata);
+
+#endif  // __SKYHOOK_TRANSPORT_CURL_CALLBACKS_H__
@@ -0,0 +1,62 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "DedupRing.h"
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cstring>
+
+DedupRing::DedupRing(size_t capacity) : ring(std::max<size_t>(capacity, 1)) {
+    // Sized up front so that the set never rehashes
+    seen.reserve(ring.size());
+}
+
+uint64_t DedupRing::fingerprint(const std::string &objUuid, const std::vector<uint8_t> &data) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(context, EVP_sha256(), nullptr);
+    EVP_DigestUpdate(context, objUuid.data(), objUuid.size());
+    // Separates the key from the content, so that neither can stand in for part of the other
+    EVP_DigestUpdate(context, "", 1);
+    EVP_DigestUpdate(context, data.data(), data.size());
+    EVP_DigestFinal_ex(context, hash, nullptr);
+    EVP_MD_CTX_free(context);
+    uint64_t result;
+    std::memcpy(&result, hash, sizeof(result));
+    return result;
+}
+
+bool DedupRing::insert(const std::string &objUuid, const std::vector<uint8_t> &data) {
+    uint64_t value = fingerprint(objUuid, data);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (seen.count(value) != 0) {
+        return false;
+    }
+    if (size == ring.size()) {
+        seen.erase(ring[next]);
+    } else {
+        ++size;
+    }
+    ring[next] = value;
+    next = (next + 1) % ring.size();
+    seen.insert(value);
+    return true;
+}
@@ -0,0 +1,61 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_DEDUP_RING_H__
+#define __SKYHOOK_TRANSPORT_DEDUP_RING_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Number of most recently received objects a link remembers to drop duplicates of
+const size_t DEFAULT_DEDUP_CAPACITY = 128;
+
+/**
+ * @brief Fixed-size memory of the most recently received objects, to drop objects that are
+ * received again. Objects are identified by their key and a digest of their content, so that
+ * different content posted to the same object, as on a single receive link, isn't mistaken for a
+ * duplicate. Fingerprints are kept in a ring, the oldest being forgotten first, and indexed by a
+ * hash set that never grows beyond the ring, so memory stays constant. This class is thread-safe.
+ */
+class DedupRing {
+public:
+    explicit DedupRing(size_t capacity = DEFAULT_DEDUP_CAPACITY);
+
+    /**
+     * @brief Remember a received object, unless it was already received.
+     *
+     * @param objUuid UUID of the object
+     * @param data Content of the object
+     * @return true if the object is new, false if it is a duplicate
+     */
+    bool insert(const std::string &objUuid, const std::vector<uint8_t> &data);
+
+private:
+    static uint64_t fingerprint(const std::string &objUuid, const std::vector<uint8_t> &data);
+
+    std::mutex mutex;
+    std::vector<uint64_t> ring;
+    // Position of the oldest fingerprint once the ring is full, and the number held until then
+    size_t next{0};
+    size_t size{0};
+    std::unordered_set<uint64_t> seen;
+};
+
+#endif  // __SKYHOOK_TRANSPORT_DEDUP_RING_H__
@@ -40,6 +40,41 @@ struct ActionJson {
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ActionJson, linkId, type);
 
+enum EventType {
+    EVENT_UNDEF,
+    EVENT_POST,
+    EVENT_RECEIVE,
+    EVENT_DRAIN,
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(EventType, {
+                                            {EVENT_UNDEF, nullptr},
+                                            {EVENT_POST, "post"},
+                                            {EVENT_RECEIVE, "receive"},
+                                            {EVENT_DRAIN, "drain"},
+                                        });
+
+struct EventJson {
+    std::string linkId;
+    EventType type;
+    // GET requests of the fetches the link made on its own, outside the user model's timeline,
+    // for drain events
+    int requests{0};
+};
+
+inline void to_json(nlohmann::json &destJson, const EventJson &srcEventJson) {
+    destJson = nlohmann::json{{"linkId", srcEventJson.linkId}, {"type", srcEventJson.type}};
+    if (srcEventJson.requests != 0) {
+        destJson["requests"] = srcEventJson.requests;
+    }
+}
+
+inline void from_json(const nlohmann::json &srcJson, EventJson &destEventJson) {
+    srcJson.at("linkId").get_to(destEventJson.linkId);
+    srcJson.at("type").get_to(destEventJson.type);
+    destEventJson.requests = srcJson.value("requests", 0);
+}
+
 struct EncodingParamsJson {
     int maxBytes;
 };
@@ -22,10 +22,14 @@
 #include <base64.h>
 #include <sstream>
 
+#include <algorithm>
 #include <chrono>
+#include <future>
 #include <nlohmann/json.hpp>
+#include <optional>
 
 #include "PersistentStorageHelpers.h"
+#include "CurlCallbacks.h"
 #include "curlwrap.h"
 #include "log.h"
 #include <openssl/sha.h>
@@ -33,19 +37,56 @@
 
 static const size_t ACTION_QUEUE_MAX_CAPACITY = 10;
 
+// Status reported for posts whose content was refused by the content budget. The budget is only
+// exhausted when posts aren't draining to S3, so report it as a network error.
+static const PackageStatus PACKAGE_FAILED_OVER_BUDGET = PACKAGE_FAILED_NETWORK_ERROR;
+
+// Every fetch and post must complete within a multiple of the link's expected latency, but never
+// less than the minimum, plus the time to transfer its content at the link's expected bandwidth
+static const int OPERATION_BUDGET_LATENCY_FACTOR = 3;
+static const std::chrono::milliseconds MIN_OPERATION_BUDGET(10000);
+
+// On links whose receiver probes ahead, how long after its object was assigned a post may still
+// land in it. Posts to consecutive objects complete out of order, so a gap is usually a post still
+// in flight or being retried, but one whose post failed for good would block the link forever.
+// The receiver skips a gap once this long has passed, plus however long the fetch that could have
+// seen the object took, so the sender gives up on the object first and fails its package rather
+// than have it reported sent and never delivered.
+static const std::chrono::seconds POST_OBJECT_HORIZON(60);
+
 namespace std {
 static std::ostream &operator<<(std::ostream &out, const std::vector<RaceHandle> &handles) {
     return out << nlohmann::json(handles).dump();
 }
 }  // namespace std
 
+Link::LinkMetrics::LinkMetrics(MetricsRegistry &registry, const LinkID &linkId) :
+    fetches(registry.sharedCounter(MetricsRegistry::linkMetric("fetch_count", linkId))),
+    emptyFetches(registry.sharedCounter(MetricsRegistry::linkMetric("empty_fetch_count", linkId))),
+    bytesReceived(registry.sharedCounter(MetricsRegistry::linkMetric("bytes_received", linkId))),
+    posts(registry.sharedCounter(MetricsRegistry::linkMetric("post_count", linkId))),
+    postRetries(registry.sharedCounter(MetricsRegistry::linkMetric("post_retry_count", linkId))),
+    failedPosts(registry.sharedCounter(MetricsRegistry::linkMetric("post_failed_count", linkId))),
+    bytesSent(registry.sharedCounter(MetricsRegistry::linkMetric("bytes_sent", linkId))),
+    expiredOperations(
+        registry.sharedCounter(MetricsRegistry::linkMetric("expired_operation_count", linkId))),
+    skippedObjects(
+        registry.sharedCounter(MetricsRegistry::linkMetric("skipped_object_count", linkId))),
+    drainFetches(registry.sharedCounter(MetricsRegistry::linkMetric("drain_fetch_count", linkId))),
+    duplicatesDropped(
+        registry.sharedCounter(MetricsRegistry::linkMetric("duplicate_receive_count", linkId))),
+    queueDepth(registry.sharedGauge(MetricsRegistry::linkMetric("action_queue_depth", linkId))),
+    fetchLatency(registry.sharedHistogram(MetricsRegistry::linkMetric("fetch_latency_us", linkId))),
+    postLatency(registry.sharedHistogram(MetricsRegistry::linkMetric("post_latency_us", linkId))) {}
+
 Link::Link(const LinkID &linkId, const LinkAddress &address, const LinkProperties &properties,
            bool isCreator, SkyhookTransport *transport, ITransportSdk *sdk) :
     address(std::move(address)),
     sdk(sdk),
     transport(transport),
     linkId(std::move(linkId)),
-    properties(std::move(properties)) {
+    properties(std::move(properties)),
+    metrics(transport->metrics, this->linkId) {
     logDebug("CREATING LINK");
 
     // Do this _before_ we potentially flip it for internal use
@@ -61,8 +102,42 @@ Link::Link(const LinkID &linkId, const LinkAddress &address, const LinkPropertie
         this->address.initialPostObjUuid = this->address.initialFetchObjUuid;
         this->address.fetchBucket = newFetchBucket;
         this->address.initialFetchObjUuid = newInitialFetchObjUuid;
+        std::swap(this->address.fetchStripeBuckets, this->address.postStripeBuckets);
         logDebug("internal address " + nlohmann::json(this->address).dump());
     }
+
+    fetchObjUuid = this->address.initialFetchObjUuid;
+    postObjUuid = this->address.initialPostObjUuid;
+
+    // Resume from where the link was before a restart rather than walking the chain again
+    checkpointKey = RatchetStore::keyFor(this->address);
+    restoredCheckpoint = transport->ratchetStore.load(checkpointKey);
+    if (restoredCheckpoint.is_object()) {
+        try {
+            fetchObjUuid = restoredCheckpoint.value("fetch", fetchObjUuid);
+            postObjUuid = restoredCheckpoint.value("post", postObjUuid);
+            logInfo("restored ratchet positions of link " + this->linkId + ", fetch: " +
+                    fetchObjUuid + ", post: " + postObjUuid);
+        } catch (nlohmann::json::exception &error) {
+            logError("ignoring invalid checkpoint of link " + this->linkId + ": " +
+                     std::string(error.what()));
+            fetchObjUuid = this->address.initialFetchObjUuid;
+            postObjUuid = this->address.initialPostObjUuid;
+            restoredCheckpoint = nullptr;
+        }
+    }
+
+    // Posts to consecutive objects can be in flight at once, but the receiver only has
+    // openObjects of them open at a time. A single receive object can only take one at a time.
+    postWindow = this->address.singleReceive ?
+                     1 :
+                     std::max(1, std::min(this->address.postWindow, this->address.openObjects));
+    // Only openObjects objects after the expected one can ever have been posted
+    lookahead = this->address.singleReceive ?
+                    0 :
+                    std::max(0, std::min(this->address.lookahead, this->address.openObjects));
+    auto now = std::chrono::steady_clock::now();
+    skipDelay = POST_OBJECT_HORIZON + (operationDeadline(false, now) - now);
 }
 
 Link::~Link() {
@@ -78,11 +153,22 @@ const LinkProperties &Link::getProperties() const {
     return properties;
 }
 
+LinkParameters Link::getUserModelParameters() const {
+    return {nlohmann::json{{"fetch_requests", 1 + lookahead}}.dump()};
+}
+
 ComponentStatus Link::enqueueContent(uint64_t actionId, const std::vector<uint8_t> &content) {
     TRACE_METHOD(linkId, actionId);
+    auto buffer = transport->contentBudget.allocate(linkId, content);
     {
         std::lock_guard<std::mutex> lock(mutex);
-        contentQueue[actionId] = content;
+        if (not buffer) {
+            logWarning(logPrefix + "content budget exceeded, refusing content for action ID: " +
+                       std::to_string(actionId));
+            refusedContent.insert(actionId);
+            return COMPONENT_OK;
+        }
+        contentQueue[actionId] = {std::move(buffer), std::chrono::steady_clock::now()};
     }
     return COMPONENT_OK;
 }
@@ -95,6 +181,7 @@ ComponentStatus Link::dequeueContent(uint64_t actionId) {
         if (iter != contentQueue.end()) {
             contentQueue.erase(iter);
         }
+        refusedContent.erase(actionId);
     }
     return COMPONENT_OK;
 }
@@ -109,13 +196,27 @@ ComponentStatus Link::fetch(std::vector<RaceHandle> handles) {
 
     std::lock_guard<std::mutex> lock(mutex);
 
+    if (fetchPending) {
+        // Merge into the pending fetch rather than issuing a duplicate GET behind it
+        auto queuedFetch = std::find_if(actionQueue.begin(), actionQueue.end(),
+                                        [](const QueuedAction &action) { return not action.post; });
+        auto &pendingHandles =
+            queuedFetch != actionQueue.end() ? queuedFetch->handles : inFlightFetchHandles;
+        pendingHandles.insert(pendingHandles.end(), handles.begin(), handles.end());
+        logDebug(logPrefix + "fetch already pending, coalescing");
+        return COMPONENT_OK;
+    }
+
     if (actionQueue.size() >= ACTION_QUEUE_MAX_CAPACITY) {
         logError(logPrefix + "action queue full for link: " + linkId);
         return COMPONENT_ERROR;
     }
 
-    // TODO commented out for testing
-    actionQueue.push_back({false, std::move(handles), 0});
+    fetchPending = true;
+    QueuedAction action{false, std::move(handles), 0, nullptr};
+    action.queued = std::chrono::steady_clock::now();
+    actionQueue.push_back(std::move(action));
+    metrics.queueDepth->set(actionQueue.size());
     conditionVariable.notify_one();
     return COMPONENT_OK;
 }
@@ -135,55 +236,413 @@ ComponentStatus Link::post(std::vector<RaceHandle> handles, uint64_t actionId) {
         return COMPONENT_ERROR;
     }
 
-    if (contentQueue.find(actionId) == contentQueue.end()) {
-        updatePackageStatus(handles, PACKAGE_FAILED_GENERIC);
+    auto iter = contentQueue.find(actionId);
+    if (iter == contentQueue.end()) {
+        bool refused = refusedContent.erase(actionId) > 0;
+        updatePackageStatus(handles, refused ? PACKAGE_FAILED_OVER_BUDGET : PACKAGE_FAILED_GENERIC);
         return COMPONENT_OK;
     }
 
-    actionQueue.push_back({true, std::move(handles), actionId});
+    QueuedAction action{true, std::move(handles), actionId, std::move(iter->second.content)};
+    action.enqueued = iter->second.enqueued;
+    action.queued = std::chrono::steady_clock::now();
+    actionQueue.push_back(std::move(action));
+    metrics.queueDepth->set(actionQueue.size());
+    contentQueue.erase(iter);
     conditionVariable.notify_one();
     return COMPONENT_OK;
 }
 
+uint64_t Link::getExpiredOperations() const {
+    return metrics.expiredOperations->get();
+}
+
+std::chrono::steady_clock::time_point Link::operationDeadline(
+    bool post, std::chrono::steady_clock::time_point start, size_t bytes) const {
+    const LinkPropertySet &expected = post ? properties.expected.send : properties.expected.receive;
+    auto budget = std::max(MIN_OPERATION_BUDGET, std::chrono::milliseconds(expected.latency_ms) *
+                                                     OPERATION_BUDGET_LATENCY_FACTOR);
+    if (expected.bandwidth_bps > 0) {
+        budget += std::chrono::milliseconds(static_cast<int64_t>(bytes) * 8 * 1000 /
+                                            expected.bandwidth_bps);
+    }
+    return start + budget;
+}
+
 void Link::start() {
     TRACE_METHOD(linkId);
-    thread = std::thread(&Link::runActionThread, this);
+    for (int idx = 0; idx < postWindow; ++idx) {
+        threads.emplace_back(&Link::runActionThread, this);
+    }
+    for (int idx = 0; idx < lookahead; ++idx) {
+        probeThreads.emplace_back(&Link::runProbeThread, this);
+    }
 }
 
 void Link::shutdown() {
     TRACE_METHOD(linkId);
-    isShutdown = true;
-    conditionVariable.notify_one();
-    if (thread.joinable()) {
-        thread.join();
+    bool alreadyShutdown;
+    {
+        // Set under the lock so the action thread can't miss the wakeup
+        std::lock_guard<std::mutex> lock(mutex);
+        alreadyShutdown = isShutdown;
+        isShutdown = true;
+    }
+    {
+        // The probe threads wait on their own mutex, so go through it for them not to miss the
+        // wakeup either
+        std::lock_guard<std::mutex> lock(probeMutex);
+    }
+    cancelToken.cancel();
+    conditionVariable.notify_all();
+    probeConditionVariable.notify_all();
+    for (auto &thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    // Only after the action threads, whose fetches may be waiting on probes
+    for (auto &thread : probeThreads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
+
+    // Fail whatever didn't get posted
+    std::deque<QueuedAction> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        abandoned.swap(actionQueue);
+        contentQueue.clear();
+    }
+    for (auto &action : abandoned) {
+        if (action.post) {
+            updatePackageStatus(action.handles, PACKAGE_FAILED_GENERIC);
+        }
+    }
+
+    // Only once, the base destructor shuts down again after the subclass is gone and would save a
+    // checkpoint without its part
+    if (not alreadyShutdown) {
+        std::lock_guard<std::mutex> lock(mutex);
+        saveCheckpoint();
+    }
+}
+
+std::deque<Link::QueuedAction>::iterator Link::nextRunnableAction(
+    std::chrono::steady_clock::time_point now) {
+    for (auto iter = actionQueue.begin(); iter != actionQueue.end(); ++iter) {
+        if (not iter->post) {
+            // Fetches are coalesced, so a queued fetch is never behind one in flight
+            return iter;
+        }
+        if (not iter->objUuid.empty()) {
+            // A post being retried keeps its object, it only has to wait out its backoff
+            if (iter->notBefore <= now) {
+                return iter;
+            }
+        } else if (outstandingPosts < postWindow) {
+            // New posts take the next objects in the chain in the order they were queued
+            return iter;
+        }
+    }
+    return actionQueue.end();
 }
 
 void Link::runActionThread() {
     TRACE_METHOD(linkId);
     logPrefix += linkId + ": ";
+    RequestLedger::LinkScope ledgerScope(linkId);
 
-    std::string fetchObjUuid = address.initialFetchObjUuid;
-    std::string postObjUuid = address.initialPostObjUuid;
-
+    std::unique_lock<std::mutex> lock(mutex);
     while (not isShutdown) {
-        std::unique_lock<std::mutex> lock(mutex);
-        conditionVariable.wait(lock, [this] { return isShutdown or not actionQueue.empty(); });
-
-        if (isShutdown) {
-            logDebug(logPrefix + "shutting down");
-            break;
+        auto now = std::chrono::steady_clock::now();
+        auto next = nextRunnableAction(now);
+        if (next == actionQueue.end()) {
+            auto nextRetry = std::chrono::steady_clock::time_point::max();
+            for (auto &action : actionQueue) {
+                if (action.post and not action.objUuid.empty()) {
+                    nextRetry = std::min(nextRetry, action.notBefore);
+                }
+            }
+            if (nextRetry != std::chrono::steady_clock::time_point::max()) {
+                conditionVariable.wait_until(lock, nextRetry);
+            } else {
+                conditionVariable.wait(lock);
+            }
+            continue;
         }
 
-        auto action = actionQueue.front();
-        actionQueue.pop_front();
+        auto action = std::move(*next);
+        actionQueue.erase(next);
+        metrics.queueDepth->set(actionQueue.size());
+        std::string objUuid;
+        if (not action.post) {
+            inFlightFetchHandles = std::move(action.handles);
+            objUuid = fetchObjUuid;
+        } else {
+            if (action.objUuid.empty()) {
+                if (not unfilledPostObjUuids.empty()) {
+                    // The receiver is stuck on this one, so fill it before taking a new one
+                    action.objUuid = unfilledPostObjUuids.front();
+                    unfilledPostObjUuids.pop_front();
+                } else {
+                    action.objUuid = postObjUuid;
+                    assignedPostObjUuids.push_back(postObjUuid);
+                    postObjUuid = generateNextObjUuid(postObjUuid);
+                }
+                action.objAssigned = now;
+                ++outstandingPosts;
+            }
+            objUuid = action.objUuid;
+        }
+        // The clock starts at dispatch, so time spent queued doesn't eat into the attempt
+        action.deadline = operationDeadline(action.post, std::chrono::steady_clock::now(),
+                                            action.content ? action.content->size() : 0);
+        if (action.post and not action.filler and lookahead > 0) {
+            action.deadline = std::min(action.deadline, action.objAssigned + POST_OBJECT_HORIZON);
+        }
+        // Sampled by object, so that the post of an object and the fetch of it are traced together
+        std::optional<TraceContext> trace;
+        if (transport->tracer.isSampled(objUuid)) {
+            trace = TraceContext{&transport->tracer, linkId, action.actionId, objUuid,
+                                 action.post ? action.handles : inFlightFetchHandles};
+        }
+        ActiveTraceContext activeTrace(trace ? &*trace : nullptr);
+        // Don't block enqueueing of new content or actions while talking to S3
+        lock.unlock();
 
         if (action.post) {
-            postObjUuid = postOnActionThread(postObjUuid, action.handles, action.actionId);
+            std::chrono::milliseconds retryAfter(0);
+            auto start = std::chrono::steady_clock::now();
+            bool posted = action.content and
+                          postOnActionThread(objUuid, action.content, action.deadline, retryAfter);
+            metrics.postLatency->recordSince(start);
+            metrics.posts->add();
+            if (trace) {
+                traceAttempt(*trace, action, start, std::chrono::steady_clock::now(), posted);
+            }
+            if (not posted and std::chrono::steady_clock::now() >= action.deadline) {
+                logWarning(logPrefix + "post overran its deadline");
+                metrics.expiredOperations->add();
+            }
+            // The receiver may skip the object once the horizon has passed, or surely has once
+            // its skip delay has, by which time filling it is no use either
+            bool pastHorizon =
+                lookahead > 0 and
+                std::chrono::steady_clock::now() >=
+                    action.objAssigned + (action.filler ? skipDelay : POST_OBJECT_HORIZON);
+            if (not posted and action.content and not pastHorizon and
+                ++action.tries < address.maxTries and not cancelToken.isCancelled()) {
+                auto delay = backoff.delay(action.tries, retryAfter);
+                logDebug(logPrefix + "post failed, retrying in " + std::to_string(delay.count()) +
+                         " ms");
+                action.queued = std::chrono::steady_clock::now();
+                action.notBefore = action.queued + delay;
+                metrics.postRetries->add();
+                lock.lock();
+                // Put it back ahead of the other posts so it is picked up as soon as it is due
+                actionQueue.push_front(std::move(action));
+                metrics.queueDepth->set(actionQueue.size());
+                continue;
+            }
+
+            if (posted and action.filler) {
+                logInfo(logPrefix + "filled object of failed post: " + objUuid);
+            } else if (action.filler) {
+                logWarning(logPrefix + "gave up filling object of failed post: " + objUuid);
+            } else if (posted) {
+                metrics.bytesSent->add(action.content->size());
+                updatePackageStatus(action.handles, PACKAGE_SENT);
+                notifyUserModel(EVENT_POST);
+            } else if (cancelToken.isCancelled()) {
+                metrics.failedPosts->add();
+                logError(logPrefix + "link shut down: post failed");
+                updatePackageStatus(action.handles, PACKAGE_FAILED_GENERIC);
+            } else if (pastHorizon) {
+                metrics.failedPosts->add();
+                logError(logPrefix + "object may be skipped by the receiver: post failed");
+                updatePackageStatus(action.handles, PACKAGE_FAILED_GENERIC);
+            } else {
+                metrics.failedPosts->add();
+                logError(logPrefix + "retry limit exceeded: post failed");
+                updatePackageStatus(action.handles, PACKAGE_FAILED_GENERIC);
+            }
+            lock.lock();
+            if (not posted and not cancelToken.isCancelled() and
+                generateNextObjUuid(objUuid) != postObjUuid) {
+                // Later objects were assigned, and the receiver can't get past this one until
+                // something lands in it. Hand it to the next post waiting for an object, unless
+                // the receiver may skip it before that post lands, or fill it with an empty one,
+                // keeping it in the window either way.
+                auto waiting = std::find_if(actionQueue.begin(), actionQueue.end(),
+                                            [](const QueuedAction &queued) {
+                                                return queued.post and queued.objUuid.empty();
+                                            });
+                if (lookahead == 0 and waiting != actionQueue.end()) {
+                    waiting->objUuid = objUuid;
+                    waiting->objAssigned = action.objAssigned;
+                    conditionVariable.notify_one();
+                    continue;
+                }
+                if (not action.filler) {
+                    QueuedAction filler{true, {}, 0, makeContentBuffer({})};
+                    filler.objUuid = objUuid;
+                    filler.objAssigned = action.objAssigned;
+                    filler.filler = true;
+                    filler.enqueued = filler.queued = std::chrono::steady_clock::now();
+                    actionQueue.push_front(std::move(filler));
+                    metrics.queueDepth->set(actionQueue.size());
+                    conditionVariable.notify_one();
+                    continue;
+                }
+                if (lookahead == 0) {
+                    // The filler failed too. Rather than hold on to a place in the window, leave
+                    // the object to the next post, which takes it before any new object.
+                    unfilledPostObjUuids.push_back(objUuid);
+                    --outstandingPosts;
+                    conditionVariable.notify_one();
+                    continue;
+                }
+                // Otherwise the receiver skips it
+            }
+            --outstandingPosts;
+            auto assigned = std::find(assignedPostObjUuids.begin(), assignedPostObjUuids.end(), objUuid);
+            if (assigned != assignedPostObjUuids.end()) {
+                assignedPostObjUuids.erase(assigned);
+            }
+            if (not posted and generateNextObjUuid(objUuid) == postObjUuid) {
+                // Nothing was assigned after the failed object, so reuse it for the next post
+                postObjUuid = objUuid;
+            }
+            saveCheckpoint();
         } else {
-            fetchObjUuid = fetchOnActionThread(fetchObjUuid);
+            auto start = std::chrono::steady_clock::now();
+            std::string nextFetchObjUuid = fetchOnActionThread(objUuid, action.deadline);
+            metrics.fetchLatency->recordSince(start);
+            metrics.fetches->add();
+            if (trace) {
+                traceAttempt(*trace, action, start, std::chrono::steady_clock::now(),
+                             nextFetchObjUuid != objUuid);
+            }
+            if (nextFetchObjUuid != objUuid) {
+                int drainRequests = 0;
+                nextFetchObjUuid = drainOnActionThread(nextFetchObjUuid, drainRequests);
+                notifyUserModel(EVENT_RECEIVE);
+                if (drainRequests > 0) {
+                    notifyUserModel(EVENT_DRAIN, drainRequests);
+                }
+            } else {
+                metrics.emptyFetches->add();
+            }
+
+            lock.lock();
+            fetchObjUuid = nextFetchObjUuid;
+            if (nextFetchObjUuid != objUuid) {
+                saveCheckpoint();
+            }
+            if (nextFetchObjUuid == objUuid and std::chrono::steady_clock::now() >= action.deadline) {
+                logWarning(logPrefix + "fetch overran its deadline");
+                metrics.expiredOperations->add();
+            }
+            if (nextFetchObjUuid == objUuid and std::chrono::steady_clock::now() >= action.deadline and
+                ++action.tries < address.maxTries and not isShutdown) {
+                // The fetch was aborted rather than finding nothing, so try it again right away
+                action.handles = std::move(inFlightFetchHandles);
+                action.queued = std::chrono::steady_clock::now();
+                actionQueue.push_front(std::move(action));
+                metrics.queueDepth->set(actionQueue.size());
+                continue;
+            }
+
+            // Fetch handles carry no packages, so completing them is just releasing them
+            fetchPending = false;
+            inFlightFetchHandles.clear();
         }
     }
+    logDebug(logPrefix + "shutting down");
+}
+
+void Link::runProbeThread() {
+    TRACE_METHOD(linkId);
+    RequestLedger::LinkScope ledgerScope(linkId);
+
+    std::unique_lock<std::mutex> lock(probeMutex);
+    while (true) {
+        // Finish the probes already queued on shutdown, a fetch is waiting for them
+        probeConditionVariable.wait(lock, [this] { return isShutdown or not probeQueue.empty(); });
+        if (probeQueue.empty()) {
+            break;
+        }
+        auto probe = std::move(probeQueue.front());
+        probeQueue.pop_front();
+        lock.unlock();
+        probe();
+        lock.lock();
+    }
+}
+
+nlohmann::json Link::buildCheckpoint() {
+    return {
+        {"fetch", fetchObjUuid},
+        {"post", assignedPostObjUuids.empty() ? postObjUuid : assignedPostObjUuids.front()},
+    };
+}
+
+void Link::saveCheckpoint() {
+    if (checkpointErased) {
+        return;
+    }
+    transport->ratchetStore.save(checkpointKey, buildCheckpoint());
+}
+
+void Link::eraseCheckpoint() {
+    TRACE_METHOD(linkId);
+    std::lock_guard<std::mutex> lock(mutex);
+    checkpointErased = true;
+    transport->ratchetStore.erase(checkpointKey);
+}
+
+void Link::releaseObjects() {
+    // The public user holds nothing in the buckets, they belong to the account holder
+}
+
+std::string Link::drainOnActionThread(const std::string &objUuid, int &requests) {
+    // The peer is evidently posting, so keep fetching until the chain runs dry rather than waiting
+    // for the next scheduled fetch for every object
+    std::string drainObjUuid = objUuid;
+    for (int fetches = 0; fetches < address.drainLimit and not cancelToken.isCancelled();
+         ++fetches) {
+        auto start = std::chrono::steady_clock::now();
+        std::string nextObjUuid =
+            fetchOnActionThread(drainObjUuid, operationDeadline(false, start));
+        metrics.fetchLatency->recordSince(start);
+        metrics.drainFetches->add();
+        // Every fetch probes the lookahead objects too
+        requests += 1 + lookahead;
+        if (nextObjUuid == drainObjUuid) {
+            break;
+        }
+        drainObjUuid = nextObjUuid;
+    }
+    return drainObjUuid;
+}
+
+void Link::traceAttempt(const TraceContext &context, const QueuedAction &action,
+                        std::chrono::steady_clock::time_point dispatched,
+                        std::chrono::steady_clock::time_point completed, bool succeeded) {
+    Tracer &tracer = *context.tracer;
+    if (action.post and action.tries == 0) {
+        tracer.addSpan(context, "content_wait", "queue", action.enqueued, action.queued);
+    }
+    // After a failed attempt the action waits out its backoff rather than the queue
+    tracer.addSpan(context, action.tries == 0 ? "queue_wait" : "retry_wait", "queue", action.queued,
+                   dispatched);
+    tracer.addSpan(context, action.post ? "post" : "fetch", "link", dispatched, completed,
+                   {{"try", action.tries + 1}, {action.post ? "posted" : "found", succeeded}});
+    if (succeeded) {
+        tracer.addFlow(context, action.post, completed);
+    }
 }
 
 std::string Link::generateNextObjUuid(const std::string &currentObjUuid) {
@@ -197,23 +656,99 @@ std::string Link::generateNextObjUuid(const std::string &currentObjUuid) {
     return ss.str();    
 }
 
-/**
- * @brief callback function required by libcurl-dev.
- * See documentation in link below:
- * https://curl.haxx.se/libcurl/c/libcurl-tutorial.html
- */
-static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
+size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
     (static_cast<std::string *>(userp))->append(static_cast<char *>(contents), size * nmemb);
     return size * nmemb;
 }
 
-std::string Link::fetchOnActionThread(const std::string &fetchObjUuid) {
+/**
+ * @brief Get the time left until the deadline, in the form curl expects for timeouts
+ */
+static long remainingMs(std::chrono::steady_clock::time_point deadline) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    // Zero would mean no timeout at all
+    return std::max(1L, static_cast<long>(remaining.count()));
+}
+
+std::string Link::fetchOnActionThread(const std::string &fetchObjUuid,
+                                      std::chrono::steady_clock::time_point deadline) {
     TRACE_METHOD(linkId, fetchObjUuid);
     logPrefix += linkId + ": ";
 
-    std::string nextFetchObjUuid = fetchObjUuid;
+    std::vector<std::string> objUuids{fetchObjUuid};
+    for (int idx = 0; idx < lookahead; ++idx) {
+        objUuids.push_back(generateNextObjUuid(objUuids.back()));
+    }
+    std::vector<std::vector<uint8_t>> contents(objUuids.size());
+    std::vector<bool> found(objUuids.size(), false);
+    {
+        // Probe the lookahead objects on the link's probe threads, carrying on this one's trace
+        const TraceContext *trace = ActiveTraceContext::get();
+        std::vector<std::future<bool>> probes;
+        {
+            std::lock_guard<std::mutex> lock(probeMutex);
+            for (size_t idx = 1; idx < objUuids.size(); ++idx) {
+                probeQueue.emplace_back([this, trace, idx, deadline, &objUuids, &contents]() {
+                    ActiveTraceContext activeTrace(trace);
+                    return fetchObject(objUuids[idx], deadline, contents[idx]);
+                });
+                probes.push_back(probeQueue.back().get_future());
+            }
+        }
+        probeConditionVariable.notify_all();
+        found[0] = fetchObject(objUuids[0], deadline, contents[0]);
+        for (size_t idx = 1; idx < objUuids.size(); ++idx) {
+            found[idx] = probes[idx - 1].get();
+        }
+    }
+
+    auto firstMissing = std::find(found.begin(), found.end(), false) - found.begin();
+    auto lastFound = std::find(found.rbegin(), found.rend(), true).base() - found.begin() - 1;
+    bool skipGap = false;
+    if (firstMissing < lastFound) {
+        auto now = std::chrono::steady_clock::now();
+        if (gapObjUuid != objUuids[firstMissing]) {
+            gapObjUuid = objUuids[firstMissing];
+            gapSince = now;
+        }
+        skipGap = now - gapSince >= skipDelay;
+    } else {
+        gapObjUuid.clear();
+    }
+
+    size_t consumed = 0;
+    for (; consumed < objUuids.size(); ++consumed) {
+        if (found[consumed]) {
+            logInfo(logPrefix + "response: " + describePayload(contents[consumed]));
+            deliverReceived(objUuids[consumed], contents[consumed]);
+        } else if (skipGap and static_cast<ptrdiff_t>(consumed) == firstMissing) {
+            logWarning(logPrefix + "skipping object missing for " +
+                       std::to_string(std::chrono::duration_cast<std::chrono::seconds>(skipDelay)
+                                          .count()) +
+                       " s: " + gapObjUuid);
+            metrics.skippedObjects->add();
+            gapObjUuid.clear();
+        } else {
+            break;
+        }
+        releaseFetchedObject(objUuids[consumed]);
+    }
+
+    if (consumed == 0) {
+        return fetchObjUuid;
+    }
+    return consumed < objUuids.size() ? objUuids[consumed] : generateNextObjUuid(objUuids.back());
+}
+
+bool Link::fetchObject(const std::string &objUuid, std::chrono::steady_clock::time_point deadline,
+                       std::vector<uint8_t> &data) {
+    TRACE_METHOD(linkId, objUuid);
+    logPrefix += linkId + ": ";
+
     try {
-        std::string url = "https://s3." + address.region + ".amazonaws.com/" + address.fetchBucket + "/" + fetchObjUuid;
+        ObjectLocation location = fetchObjectLocation(address, objUuid);
+        std::string url = s3ObjectUrl(address, location.bucket, location.key);
             
         CurlWrap curl;
         std::string response;
@@ -223,14 +758,15 @@ std::string Link::fetchOnActionThread(const std::string &fetchObjUuid) {
         curl.setopt(CURLOPT_WRITEFUNCTION, WriteCallback);
         curl.setopt(CURLOPT_WRITEDATA, &response);
         curl.setopt(CURLOPT_FAILONERROR, 1);
+        curl.setopt(CURLOPT_TIMEOUT_MS, remainingMs(deadline));
         // Fail to the curl_exception catch on 400+ responses 
-        curl.perform();
-        logInfo(logPrefix + "response: " + std::to_string(response.size()));
-        logInfo(logPrefix + "response: " + std::string(response.begin(), response.end()));
-        nextFetchObjUuid = generateNextObjUuid(fetchObjUuid);
-        std::vector<uint8_t> data(response.begin(), response.end());
-        sdk->onReceive(linkId, {linkId, "*/*", false, {}}, data);
-        
+        transport->requestLedger.record(S3_REQUEST_GET, location.bucket);
+        {
+            TraceSpan span("http_get", "network");
+            curl.perform(cancelToken);
+        }
+        data.assign(response.begin(), response.end());
+        return true;
     } catch (curl_exception &error) {
         logDebug(logPrefix + "curl exception: " + std::string(error.what()) + " assuming sender hasn't posted yet and will retry later.");
     } catch (nlohmann::json::exception &error) {
@@ -238,42 +774,41 @@ std::string Link::fetchOnActionThread(const std::string &fetchObjUuid) {
     } catch (std::exception &error) {
         logError(logPrefix + "std exception: " + std::string(error.what()));
     }
+    return false;
+}
 
-    return nextFetchObjUuid;
+void Link::releaseFetchedObject(const std::string & /* objUuid */) {
+    // Objects the public user fetches belong to the account holder, who cleans them up
 }
 
-std::string Link::postOnActionThread(const std::string &postObjUuid, const std::vector<RaceHandle> &handles, uint64_t actionId) {
-    TRACE_METHOD(linkId, handles, actionId);
-    logPrefix += linkId + ": ";
+bool Link::postOnActionThread(const std::string &postObjUuid, const ContentBuffer &content,
+                              std::chrono::steady_clock::time_point deadline,
+                              std::chrono::milliseconds &retryAfter) {
+    return postToBucket(content, postObjUuid, deadline, retryAfter);
+}
 
-    std::string nextPostObjUuid = postObjUuid;
-    auto iter = contentQueue.find(actionId);
-    if (iter == contentQueue.end()) {
-        // TODO why was this empty post necessary?
-        // postToBucket(std::vector<uint8_t>(), postObjUuid);
-        // We really shouldn't get here, since we already check for this before queueing the action,
-        // but just in case...
-        logError(logPrefix +
-                 "no enqueued content for given action ID: " + std::to_string(actionId));
-        updatePackageStatus(handles, PACKAGE_FAILED_GENERIC);
-        return nextPostObjUuid;
-    }
-
-    int tries = 0;
-    for (; tries < address.maxTries; ++tries) {
-        if (postToBucket(iter->second, postObjUuid)) {
-            break;
-        }
-    }
+void Link::notifyUserModel(EventType type, int requests) {
+    TRACE_METHOD(linkId, type, requests);
+    // The link ID is carried in the JSON rather than relying on the SDK to fill it in
+    Event event;
+    event.json = nlohmann::json(EventJson{linkId, type, requests}).dump();
+    sdk->onEvent(event);
+}
 
-    if (tries == address.maxTries) {
-        logError(logPrefix + "retry limit exceeded: post failed");
-        updatePackageStatus(handles, PACKAGE_FAILED_GENERIC);
-    } else {
-        nextPostObjUuid = generateNextObjUuid(postObjUuid);
-        updatePackageStatus(handles, PACKAGE_SENT);
+void Link::deliverReceived(const std::string &objUuid, const std::vector<uint8_t> &data) {
+    if (data.empty()) {
+        // The sender filled the object after the post assigned to it failed
+        logDebug("skipping filler object " + objUuid + " received on link " + linkId);
+        return;
+    }
+    if (not receivedObjects.insert(objUuid, data)) {
+        logDebug("dropping duplicate of object " + objUuid + " received on link " + linkId);
+        metrics.duplicatesDropped->add();
+        return;
     }
-    return nextPostObjUuid;
+    metrics.bytesReceived->add(data.size());
+    TraceSpan span("on_receive", "sdk");
+    sdk->onReceive(linkId, {linkId, "*/*", false, {}}, data);
 }
 
 void Link::updatePackageStatus(const std::vector<RaceHandle> &handles, PackageStatus status) {
@@ -282,20 +817,11 @@ void Link::updatePackageStatus(const std::vector<RaceHandle> &handles, PackageSt
     }
 }
 
-
-struct inc_copy_vec {
-    size_t current_offset;
-    const std::vector<uint8_t> *dataVec;
-};
-  
 size_t read_callback(char *ptr, size_t size, size_t nmemb, inc_copy_vec *userdata)
 {
-  logDebug("read_callback called");
   size_t ncopied = 0;
-  size_t remaining = userdata->dataVec->size() - userdata->current_offset;
-  logDebug("remaining: " + std::to_string(remaining));
+  size_t remaining = userdata->content->size() - userdata->current_offset;
   if (remaining == 0) {
-      logDebug("ncopied: " + std::to_string(ncopied));
       return ncopied;
   }
 
@@ -303,21 +829,20 @@ size_t read_callback(char *ptr, size_t size, size_t nmemb, inc_copy_vec *userdat
   if (ncopied > remaining) {
       ncopied = remaining;
   }
-  memcpy(ptr, userdata->dataVec->data() + userdata->current_offset, ncopied);
+  memcpy(ptr, userdata->content->data() + userdata->current_offset, ncopied);
   userdata->current_offset += ncopied;
- 
-  logDebug("src: " + std::string(userdata->dataVec->data(), userdata->dataVec->data() + ncopied));
-  logDebug("dst: " + std::string(ptr, ptr+ncopied));
-  logDebug("ncopied: " + std::to_string(ncopied));
-  return size*nmemb;
+  return ncopied;
 }
 
-bool Link::postToBucket(const std::vector<uint8_t> &message, const std::string &postObjUuid) {
+bool Link::postToBucket(const ContentBuffer &content, const std::string &postObjUuid,
+                        std::chrono::steady_clock::time_point deadline,
+                        std::chrono::milliseconds &retryAfter) {
     TRACE_METHOD(linkId);
     logPrefix += linkId + ": ";
     bool success = false;
 
-    std::string url = "https://s3." + address.region + ".amazonaws.com/" + address.postBucket + "/" + postObjUuid;
+    ObjectLocation location = postObjectLocation(address, postObjUuid);
+    std::string url = s3ObjectUrl(address, location.bucket, location.key);
 
     // TODO: RAII this thing
     struct curl_slist *headers = NULL;
@@ -334,21 +859,37 @@ bool Link::postToBucket(const std::vector<uint8_t> &message, const std::string &
 
         // connecton timeout. override the default and set to 10 seconds.
         curl.setopt(CURLOPT_CONNECTTIMEOUT, 10L);
+        curl.setopt(CURLOPT_TIMEOUT_MS, remainingMs(deadline));
 
         curl.setopt(CURLOPT_WRITEFUNCTION, WriteCallback);
         curl.setopt(CURLOPT_WRITEDATA, &response);
         curl.setopt(CURLOPT_HTTPHEADER, headers);
-        curl.setopt(CURLOPT_INFILESIZE, message.size());
-        
-        struct inc_copy_vec curl_msg = {0, &message};
+        curl.setopt(CURLOPT_INFILESIZE, content->size());
+
+        struct inc_copy_vec curl_msg = {0, content};
         curl_easy_setopt(curl, CURLOPT_READDATA, &curl_msg);
-        curl.perform();
-        // TODO: add XML parsing to check for application-level errors like:
+        transport->requestLedger.record(S3_REQUEST_PUT, location.bucket);
+        {
+            TraceSpan span("http_put", "network");
+            curl.perform(cancelToken);
+        }
+        // Application-level errors come back as an error status with a body like:
         //            <?xml version="1.0" encoding="UTF-8"?>
         // <Error><Code>AccessDenied</Code><Message>Access Denied</Message><RequestId>FC1STS0GMRKHPCY8</RequestId><HostId>+hdFUV92l9lcRBvKIpXeuawSa3xJVKYT7Q3KfUFl/g41QNcsQTL0HES0Rk5yELLD/oUPQtkWtKM=</HostId></Error>
-        logDebug(logPrefix + " post-response: " + response);
-        // }
-        success = true;
+        long responseCode = curl.getinfo<long>(CURLINFO_RESPONSE_CODE);
+        if (responseCode >= 400) {
+            logWarning(logPrefix + "post failed with status " + std::to_string(responseCode) +
+                       ": " + response);
+            if (responseCode == 503 or response.find("<Code>SlowDown</Code>") != std::string::npos) {
+                // S3 is throttling us, back off for at least as long as it asks
+                curl_off_t retryAfterSeconds = curl.getinfo<curl_off_t>(CURLINFO_RETRY_AFTER);
+                retryAfter = RetryBackoff::parseRetryAfter(
+                    retryAfterSeconds > 0 ? std::to_string(retryAfterSeconds) : "");
+            }
+        } else {
+            logDebug(logPrefix + " post-response: " + response);
+            success = true;
+        }
     } catch (curl_exception &error) {
         logWarning(logPrefix + "curl exception: " + std::string(error.what()));
     }
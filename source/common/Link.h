@@ -24,14 +24,25 @@
 #include <SdkResponse.h>  // RaceHandle
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <future>
 #include <mutex>
+#include <nlohmann/json.hpp>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "CancellationToken.h"
+#include "ContentBuffer.h"
+#include "DedupRing.h"
+#include "JsonTypes.h"
 #include "LinkAddress.h"
+#include "Metrics.h"
+#include "RetryBackoff.h"
+#include "Tracing.h"
 class SkyhookTransport;
 // #include "SkyhookTransport.h"
 
@@ -60,6 +71,14 @@ public:
      */
     virtual const LinkProperties &getProperties() const;
 
+    /**
+     * @brief Get the parameters the user model is given for this link, which tell it how many
+     * requests each fetch makes, so that it charges the lookahead to the request budget.
+     *
+     * @return The link parameters
+     */
+    virtual LinkParameters getUserModelParameters() const;
+
     /**
      * @brief Enqueue the given content to be posted to the whiteboard.
      *
@@ -94,45 +113,250 @@ public:
      */
     virtual ComponentStatus post(std::vector<RaceHandle> handles, uint64_t actionId);
 
+    /**
+     * @brief Delete the link's checkpoint once the link is destroyed for good, so that a link
+     * created again with the same initial objects starts afresh. The link must be shut down.
+     */
+    virtual void eraseCheckpoint();
+
+    /**
+     * @brief Give up the objects and buckets the link holds once the link is destroyed for good.
+     * The link must be shut down. Shutting down alone leaves them in place, so that a link restored
+     * from its checkpoint carries on where it left off.
+     */
+    virtual void releaseObjects();
+
     /**
      * @brief Start the link.
      */
     virtual void start();
 
     /**
-     * @brief Shutdown the link.
+     * @brief Shutdown the link: stop its threads and save its checkpoint one last time.
      */
     virtual void shutdown();
 
     static std::string generateNextObjUuid(const std::string &currentObjUuid);
 
+    /**
+     * @brief Get the number of fetches and posts that were aborted for overrunning their
+     * deadline. This function is thread-safe.
+     *
+     * @return The number of expired operations
+     */
+    virtual uint64_t getExpiredOperations() const;
+
     LinkAddress address;
 protected:
-    virtual std::string postOnActionThread(const std::string &postObjUuid, const std::vector<RaceHandle> &handles, uint64_t actionId);
-    virtual bool postToBucket(const std::vector<uint8_t> &message, const std::string &postObjUuid);
+    /**
+     * @brief Make a single attempt at posting content to the given object. Retries are scheduled
+     * by the action thread.
+     *
+     * @param postObjUuid UUID of the object to post to
+     * @param content Content to be posted
+     * @param deadline Time by which the attempt must complete, it is aborted otherwise
+     * @param retryAfter Set to the delay requested by S3 if the request was throttled
+     * @return true if the content was posted
+     */
+    virtual bool postOnActionThread(const std::string &postObjUuid, const ContentBuffer &content,
+                                    std::chrono::steady_clock::time_point deadline,
+                                    std::chrono::milliseconds &retryAfter);
+    virtual bool postToBucket(const ContentBuffer &content, const std::string &postObjUuid,
+                              std::chrono::steady_clock::time_point deadline,
+                              std::chrono::milliseconds &retryAfter);
+
+    /**
+     * @brief Fetch the expected object, and the lookahead objects after it at the same time.
+     * Whatever is found is delivered in chain order, up to the first missing object. A missing
+     * object that stays missing while later ones are found is skipped after a while.
+     *
+     * @param objUuid UUID of the expected object
+     * @param deadline Time by which the fetch must complete, it is aborted otherwise
+     * @return UUID of the next object to fetch, the given one if nothing was delivered
+     */
+    virtual std::string fetchOnActionThread(const std::string &objUuid,
+                                            std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Make a single attempt at getting an object. Called concurrently for the objects of
+     * one fetch.
+     *
+     * @param objUuid UUID of the object
+     * @param deadline Time by which the attempt must complete, it is aborted otherwise
+     * @param data Set to the content of the object if it was found
+     * @return true if the object was found
+     */
+    virtual bool fetchObject(const std::string &objUuid,
+                             std::chrono::steady_clock::time_point deadline,
+                             std::vector<uint8_t> &data);
+
+    /**
+     * @brief Let go of an object the fetch ratchet has moved past, whether it was delivered or
+     * skipped. Called in chain order.
+     *
+     * @param objUuid UUID of the object
+     */
+    virtual void releaseFetchedObject(const std::string &objUuid);
+
+    /**
+     * @brief Let the user model know that content was posted to or received on this link, so that
+     * it can poll more eagerly for a response, or that the link drained a backlog, so that it can
+     * charge the requests of the extra fetches to the link's request budget.
+     *
+     * @param type Type of the event
+     * @param requests Number of GET requests the extra fetches made, for drain events
+     */
+    virtual void notifyUserModel(EventType type, int requests = 0);
+
+    /**
+     * @brief Hand content fetched from the whiteboard to the SDK, unless the same content was
+     * already received from the same object.
+     *
+     * @param objUuid UUID of the object the content was fetched from
+     * @param data Content received
+     */
+    virtual void deliverReceived(const std::string &objUuid, const std::vector<uint8_t> &data);
 
-    virtual std::string fetchOnActionThread(const std::string &objUuid);
     ITransportSdk *sdk;
     SkyhookTransport *transport;
 
     LinkID linkId;
     LinkProperties properties;
 
+    // Handles to this link's metrics in the transport's registry, which keep them alive after the
+    // transport removes them when destroying the link
+    struct LinkMetrics {
+        LinkMetrics(MetricsRegistry &registry, const LinkID &linkId);
+
+        std::shared_ptr<Counter> fetches;
+        std::shared_ptr<Counter> emptyFetches;
+        std::shared_ptr<Counter> bytesReceived;
+        std::shared_ptr<Counter> posts;
+        std::shared_ptr<Counter> postRetries;
+        std::shared_ptr<Counter> failedPosts;
+        std::shared_ptr<Counter> bytesSent;
+        std::shared_ptr<Counter> expiredOperations;
+        std::shared_ptr<Counter> skippedObjects;
+        std::shared_ptr<Counter> drainFetches;
+        std::shared_ptr<Counter> duplicatesDropped;
+        std::shared_ptr<Gauge> queueDepth;
+        std::shared_ptr<Histogram> fetchLatency;
+        std::shared_ptr<Histogram> postLatency;
+    };
+    LinkMetrics metrics;
+
     struct QueuedAction {
         bool post;
         std::vector<RaceHandle> handles;
         uint64_t actionId;
+        // Content to be posted, moved out of the content queue when the post is queued so that it
+        // is released as soon as the post completes
+        ContentBuffer content;
+        // Times the content and the action were queued, or the last attempt failed, for tracing
+        std::chrono::steady_clock::time_point enqueued{};
+        std::chrono::steady_clock::time_point queued{};
+        // Object the post was assigned when first dispatched, kept across retries
+        std::string objUuid{};
+        // Empty post filling an object whose own post failed for good, retried like any other
+        bool filler{false};
+        // Time the object was first assigned to a post
+        std::chrono::steady_clock::time_point objAssigned{};
+        // Number of failed attempts, and the earliest time of the next one
+        int tries{0};
+        std::chrono::steady_clock::time_point notBefore{};
+        // Time by which the current attempt must complete, set when it is dispatched
+        std::chrono::steady_clock::time_point deadline{};
     };
 
-    std::thread thread;
+    // One action thread per post in flight, see postWindow
+    std::vector<std::thread> threads;
     std::atomic<bool> isShutdown{false};
+    // Cancelled on shutdown to abort transfers in flight
+    CancellationToken cancelToken;
     std::mutex mutex;
     std::condition_variable conditionVariable;
 
     std::deque<QueuedAction> actionQueue;
-    std::unordered_map<uint64_t, std::vector<uint8_t>> contentQueue;
+    // A link keeps at most one pending fetch. While a fetch is queued or in flight, further fetch
+    // requests are merged into it and their handles are completed along with it.
+    bool fetchPending{false};
+    std::vector<RaceHandle> inFlightFetchHandles;
+    struct QueuedContent {
+        ContentBuffer content;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+    std::unordered_map<uint64_t, QueuedContent> contentQueue;
+    // Action IDs whose content was refused because the content budget was exhausted
+    std::unordered_set<uint64_t> refusedContent;
+
+    // Ratchet positions: the next object to fetch and the next unassigned object to post to
+    std::string fetchObjUuid;
+    std::string postObjUuid;
+    // Objects assigned to posts that haven't completed yet, in chain order. A restart resumes
+    // posting from the first of them, so that an object whose post never landed isn't skipped.
+    std::deque<std::string> assignedPostObjUuids;
+    // Assigned objects whose post and filler both failed, on links that don't probe ahead. The
+    // receiver can't get past them, so new posts take them, in chain order, before a new object.
+    std::deque<std::string> unfilledPostObjUuids;
+    // Key of the link's checkpoint, and the checkpoint the link was restored from, if any
+    std::string checkpointKey;
+    nlohmann::json restoredCheckpoint;
+    // Set once the checkpoint is deleted, after which it is never saved again
+    bool checkpointErased{false};
+    // Maximum number of posts that may have been assigned an object without completing yet, and
+    // the current number of them
+    int postWindow;
+    int outstandingPosts{0};
+    // Number of objects after the expected one probed by every fetch
+    int lookahead;
+    // Threads probing the lookahead objects of a fetch, one per object, and the probes waiting
+    // for them
+    std::vector<std::thread> probeThreads;
+    std::mutex probeMutex;
+    std::condition_variable probeConditionVariable;
+    std::deque<std::packaged_task<bool()>> probeQueue;
+    // First missing object that later objects were found after, and when that was first seen
+    std::string gapObjUuid;
+    std::chrono::steady_clock::time_point gapSince;
+    // How long a gap must last before it is skipped, longer than the sender keeps posting to it
+    std::chrono::steady_clock::duration skipDelay;
+
+    RetryBackoff backoff;
+
+    // Recently received objects, to drop objects delivered twice by retries or lookahead
+    DedupRing receivedObjects;
+
+    /**
+     * @brief Get the time by which a fetch or post must complete, given its expected latency and,
+     * for posts, the time to upload its content.
+     *
+     * @param post Whether the operation is a post
+     * @param start Time the operation is dispatched
+     * @param bytes Size of the content to upload
+     * @return The deadline
+     */
+    std::chrono::steady_clock::time_point operationDeadline(
+        bool post, std::chrono::steady_clock::time_point start, size_t bytes = 0) const;
+    /**
+     * @brief Queue a checkpoint of the link's ratchet positions to be persisted. Must hold the
+     * mutex.
+     */
+    virtual void saveCheckpoint();
+
+    /**
+     * @brief Build the checkpoint of the link's ratchet positions. Must hold the mutex.
+     *
+     * @return The checkpoint
+     */
+    virtual nlohmann::json buildCheckpoint();
 
     void runActionThread();
+    void runProbeThread();
+    std::string drainOnActionThread(const std::string &objUuid, int &requests);
+    void traceAttempt(const TraceContext &context, const QueuedAction &action,
+                      std::chrono::steady_clock::time_point dispatched,
+                      std::chrono::steady_clock::time_point completed, bool succeeded);
+    std::deque<QueuedAction>::iterator nextRunnableAction(std::chrono::steady_clock::time_point now);
     void updatePackageStatus(const std::vector<RaceHandle> &handles, PackageStatus status);
 };
 
@@ -17,6 +17,11 @@
 
 #include "LinkAddress.h"
 
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cstdlib>
+
 void to_json(nlohmann::json &destJson, const LinkAddress &srcLinkAddress) {
     destJson = nlohmann::json{
         // clang-format off
@@ -27,9 +32,25 @@ void to_json(nlohmann::json &destJson, const LinkAddress &srcLinkAddress) {
         {"initialPostObjUuid", srcLinkAddress.initialPostObjUuid},
         {"openObjects", srcLinkAddress.openObjects},
         {"maxTries", srcLinkAddress.maxTries},
+        {"postWindow", srcLinkAddress.postWindow},
+        {"lookahead", srcLinkAddress.lookahead},
+        {"drainLimit", srcLinkAddress.drainLimit},
         {"singleReceive", srcLinkAddress.singleReceive},
         // clang-format on
     };
+    // Only written when set, so addresses of links on AWS are unchanged
+    if (not srcLinkAddress.endpoint.empty()) {
+        destJson["endpoint"] = srcLinkAddress.endpoint;
+    }
+    if (not srcLinkAddress.fetchStripeBuckets.empty()) {
+        destJson["fetchStripeBuckets"] = srcLinkAddress.fetchStripeBuckets;
+    }
+    if (not srcLinkAddress.postStripeBuckets.empty()) {
+        destJson["postStripeBuckets"] = srcLinkAddress.postStripeBuckets;
+    }
+    if (srcLinkAddress.prefixStripes > 0) {
+        destJson["prefixStripes"] = srcLinkAddress.prefixStripes;
+    }
 }
 
 void from_json(const nlohmann::json &srcJson, LinkAddress &destLinkAddress) {
@@ -42,5 +63,106 @@ void from_json(const nlohmann::json &srcJson, LinkAddress &destLinkAddress) {
     // Optional
     destLinkAddress.openObjects = srcJson.value("openObjects", destLinkAddress.openObjects);
     destLinkAddress.maxTries = srcJson.value("maxTries", destLinkAddress.maxTries);
+    destLinkAddress.postWindow = srcJson.value("postWindow", destLinkAddress.postWindow);
+    destLinkAddress.lookahead = srcJson.value("lookahead", destLinkAddress.lookahead);
+    destLinkAddress.drainLimit = srcJson.value("drainLimit", destLinkAddress.drainLimit);
     destLinkAddress.singleReceive = srcJson.value("singleReceive", destLinkAddress.singleReceive);
+    destLinkAddress.endpoint = srcJson.value("endpoint", destLinkAddress.endpoint);
+    destLinkAddress.fetchStripeBuckets =
+        srcJson.value("fetchStripeBuckets", destLinkAddress.fetchStripeBuckets);
+    destLinkAddress.postStripeBuckets =
+        srcJson.value("postStripeBuckets", destLinkAddress.postStripeBuckets);
+    destLinkAddress.prefixStripes = srcJson.value("prefixStripes", destLinkAddress.prefixStripes);
+}
+
+std::string s3EndpointOverride() {
+    const char *endpoint = std::getenv(S3_ENDPOINT_ENV_VAR);
+    if (endpoint == nullptr) {
+        return "";
+    }
+    std::string result = endpoint;
+    while (not result.empty() and result.back() == '/') {
+        result.pop_back();
+    }
+    return result;
+}
+
+std::string s3ObjectUrl(const LinkAddress &address, const std::string &bucket,
+                        const std::string &objUuid) {
+    std::string endpoint = address.endpoint.empty() ?
+                               "https://s3." + address.region + ".amazonaws.com" :
+                               address.endpoint;
+    return endpoint + "/" + bucket + "/" + objUuid;
+}
+
+/**
+ * @brief Pick the stripe of an object. Both ends of a link must agree on it, so it is taken from a
+ * hash that doesn't depend on the platform.
+ */
+static ObjectLocation stripeObject(const std::string &bucket,
+                                   const std::vector<std::string> &stripeBuckets,
+                                   int prefixStripes, const std::string &objUuid) {
+    if (stripeBuckets.empty() and prefixStripes <= 0) {
+        return {bucket, objUuid};
+    }
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char *>(objUuid.c_str()), objUuid.size(), hash);
+    uint64_t stripe = 0;
+    for (size_t i = 0; i < sizeof(stripe); ++i) {
+        stripe = (stripe << 8) | hash[i];
+    }
+
+    ObjectLocation location{bucket, objUuid};
+    uint64_t buckets = stripeBuckets.size() + 1;
+    uint64_t bucketIdx = stripe % buckets;
+    if (bucketIdx > 0) {
+        location.bucket = stripeBuckets[bucketIdx - 1];
+    }
+    if (prefixStripes > 0) {
+        location.key = std::to_string(stripe / buckets % prefixStripes) + "/" + objUuid;
+    }
+    return location;
+}
+
+ObjectLocation fetchObjectLocation(const LinkAddress &address, const std::string &objUuid) {
+    return stripeObject(address.fetchBucket, address.fetchStripeBuckets, address.prefixStripes,
+                        objUuid);
+}
+
+ObjectLocation postObjectLocation(const LinkAddress &address, const std::string &objUuid) {
+    return stripeObject(address.postBucket, address.postStripeBuckets, address.prefixStripes,
+                        objUuid);
+}
+
+static void addBucket(std::vector<std::string> &buckets, const std::string &bucket) {
+    if (std::find(buckets.begin(), buckets.end(), bucket) == buckets.end()) {
+        buckets.push_back(bucket);
+    }
+}
+
+static void addBuckets(std::vector<std::string> &buckets, const std::string &bucket,
+                       const std::vector<std::string> &stripeBuckets) {
+    addBucket(buckets, bucket);
+    for (auto &stripeBucket : stripeBuckets) {
+        addBucket(buckets, stripeBucket);
+    }
+}
+
+std::vector<std::string> fetchBuckets(const LinkAddress &address) {
+    std::vector<std::string> buckets;
+    addBuckets(buckets, address.fetchBucket, address.fetchStripeBuckets);
+    return buckets;
+}
+
+std::vector<std::string> postBuckets(const LinkAddress &address) {
+    std::vector<std::string> buckets;
+    addBuckets(buckets, address.postBucket, address.postStripeBuckets);
+    return buckets;
+}
+
+std::vector<std::string> linkBuckets(const LinkAddress &address) {
+    std::vector<std::string> buckets;
+    addBuckets(buckets, address.fetchBucket, address.fetchStripeBuckets);
+    addBuckets(buckets, address.postBucket, address.postStripeBuckets);
+    return buckets;
 }
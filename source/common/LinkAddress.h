@@ -20,6 +20,7 @@
 
 #include <nlohmann/json.hpp>
 #include <string>
+#include <vector>
 
 struct LinkAddress {
     // Required
@@ -31,10 +32,108 @@ struct LinkAddress {
     // Optional
     int openObjects{1};
     int maxTries{120};
-    bool singleReceive{false};
+    // Number of posts to consecutive objects that may be in flight at once, bounded by openObjects
+    int postWindow{1};
+    // Number of objects after the expected one that every fetch also probes, bounded by
+    // openObjects, so that a receiver that fell behind catches up in one round trip. Left off on
+    // links created by createLink, since every probe is a billable GET on every fetch; set it in
+    // the address to use it.
+    int lookahead{0};
+    // Most further fetches made straight after a fetch that found content, stopping at the first
+    // miss, so that a backlog drains without waiting for the next scheduled fetch each time. Links
+    // created by createLink use DEFAULT_DRAIN_LIMIT.
+    int drainLimit{0};
     // Used to indicate the link will keep a single static receive (S3) object and will be used by multiple clients. Rather than the ratcheting UUIDs there will only ever be a single UUID, publicly writable.
+    bool singleReceive{false};
+    // S3-compatible endpoint to use instead of AWS, e.g. "http://127.0.0.1:9000". Objects are
+    // addressed path-style under it.
+    std::string endpoint;
+    // Striping, to spread the link's requests over more of S3's per-prefix request rate limits.
+    // Objects are spread by hash over the fetch or post bucket and the extra buckets listed here,
+    // and over prefixStripes key prefixes within each bucket, or none if 0. Links created by
+    // createLink aren't striped, since the transport only knows of one bucket and a single link
+    // stays far below the limits; set these in the address to stripe a busy link.
+    std::vector<std::string> fetchStripeBuckets;
+    std::vector<std::string> postStripeBuckets;
+    int prefixStripes{0};
+};
+
+/**
+ * @brief Where an object is stored
+ */
+struct ObjectLocation {
+    std::string bucket;
+    std::string key;
 };
 
+/**
+ * @brief Get where an object the link fetches is stored, given the link's striping.
+ *
+ * @param address Address of the link, as seen from this end
+ * @param objUuid UUID of the object
+ * @return Bucket and key of the object
+ */
+ObjectLocation fetchObjectLocation(const LinkAddress &address, const std::string &objUuid);
+
+/**
+ * @brief Get where an object the link posts is stored, given the link's striping.
+ *
+ * @param address Address of the link, as seen from this end
+ * @param objUuid UUID of the object
+ * @return Bucket and key of the object
+ */
+ObjectLocation postObjectLocation(const LinkAddress &address, const std::string &objUuid);
+
+/**
+ * @brief Get the buckets the objects the link fetches are striped across, without repeats.
+ *
+ * @param address Address of the link, as seen from this end
+ * @return The buckets, the fetch bucket first
+ */
+std::vector<std::string> fetchBuckets(const LinkAddress &address);
+
+/**
+ * @brief Get the buckets the objects the link posts are striped across, without repeats.
+ *
+ * @param address Address of the link, as seen from this end
+ * @return The buckets, the post bucket first
+ */
+std::vector<std::string> postBuckets(const LinkAddress &address);
+
+/**
+ * @brief Get all buckets the link's objects are striped across, without repeats.
+ *
+ * @param address Address of the link
+ * @return The buckets, the fetch and post buckets first
+ */
+std::vector<std::string> linkBuckets(const LinkAddress &address);
+
+// Drain limit of links created by createLink. Draining only costs requests once a fetch has found
+// content, and those requests are charged to the user model's request budget.
+const int DEFAULT_DRAIN_LIMIT = 4;
+
+// Environment variable that points the account holder's S3 client at an S3-compatible endpoint
+// other than AWS, e.g. a local object store for load testing
+const char *const S3_ENDPOINT_ENV_VAR = "SKYHOOK_S3_ENDPOINT";
+
+/**
+ * @brief Get the S3 endpoint override set in the environment.
+ *
+ * @return The endpoint, or an empty string to use AWS
+ */
+std::string s3EndpointOverride();
+
+/**
+ * @brief Get the path-style URL of an object.
+ *
+ * @param address Address of the link the object belongs to
+ * @param bucket Bucket holding the object
+ * @param objUuid UUID of the object
+ * @return URL of the object
+ */
+std::string s3ObjectUrl(const LinkAddress &address, const std::string &bucket,
+                        const std::string &objUuid);
+
 // Enable automatic conversion to/from json
 void to_json(nlohmann::json &destJson, const LinkAddress &srcLinkAddress);
 void from_json(const nlohmann::json &srcJson, LinkAddress &destLinkAddress);
@@ -0,0 +1,208 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "Metrics.h"
+
+#include <nlohmann/json.hpp>
+
+#include "log.h"
+
+// Minimum time between periodic dumps of the metrics, in seconds
+static const int64_t METRICS_DUMP_PERIOD = 60;
+
+void Histogram::record(uint64_t value) {
+    buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t currentMax = max.load(std::memory_order_relaxed);
+    while (value > currentMax and
+           not max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::recordSince(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    record(static_cast<uint64_t>(std::max<int64_t>(0, elapsed.count())));
+}
+
+uint64_t Histogram::getCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getSum() const {
+    return sum.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getMax() const {
+    return max.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getQuantile(double quantile) const {
+    uint64_t total = getCount();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(quantile * total);
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            return std::min(bucketUpperBound(i), getMax());
+        }
+    }
+    return getMax();
+}
+
+int Histogram::bucketIndex(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<int>(value);
+    }
+    // The leading bit picks the power of two, the bits after it pick the sub-bucket
+    int exponent = 63 - __builtin_clzll(value);
+    int subBucket = static_cast<int>((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+}
+
+uint64_t Histogram::bucketUpperBound(int index) {
+    if (index < SUB_BUCKETS) {
+        return static_cast<uint64_t>(index);
+    }
+    int exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t subBucket = static_cast<uint64_t>(index % SUB_BUCKETS);
+    uint64_t width = uint64_t(1) << (exponent - SUB_BUCKET_BITS);
+    return ((SUB_BUCKETS + subBucket) << (exponent - SUB_BUCKET_BITS)) + (width - 1);
+}
+
+Counter &MetricsRegistry::counter(const std::string &name) {
+    return *sharedCounter(name);
+}
+
+std::shared_ptr<Counter> MetricsRegistry::sharedCounter(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &metric = counters[name];
+    if (not metric) {
+        metric = std::make_shared<Counter>();
+    }
+    return metric;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name) {
+    return *sharedGauge(name);
+}
+
+std::shared_ptr<Gauge> MetricsRegistry::sharedGauge(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &metric = gauges[name];
+    if (not metric) {
+        metric = std::make_shared<Gauge>();
+    }
+    return metric;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name) {
+    return *sharedHistogram(name);
+}
+
+std::shared_ptr<Histogram> MetricsRegistry::sharedHistogram(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &metric = histograms[name];
+    if (not metric) {
+        metric = std::make_shared<Histogram>();
+    }
+    return metric;
+}
+
+std::string MetricsRegistry::linkMetric(const std::string &name, const std::string &linkId) {
+    return name + "{link=\"" + linkId + "\"}";
+}
+
+/**
+ * @brief Erase the metrics whose name ends with the given label
+ */
+template <typename Metrics>
+static void eraseLabelled(Metrics &metrics, const std::string &label) {
+    for (auto iter = metrics.begin(); iter != metrics.end();) {
+        const std::string &name = iter->first;
+        if (name.size() >= label.size() and
+            name.compare(name.size() - label.size(), label.size(), label) == 0) {
+            iter = metrics.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void MetricsRegistry::removeLink(const std::string &linkId) {
+    const std::string label = linkMetric("", linkId);
+    std::lock_guard<std::mutex> lock(mutex);
+    eraseLabelled(counters, label);
+    eraseLabelled(gauges, label);
+    eraseLabelled(histograms, label);
+}
+
+std::string MetricsRegistry::toJson() const {
+    nlohmann::json json;
+    json["timestamp"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    json["counters"] = nlohmann::json::object();
+    json["gauges"] = nlohmann::json::object();
+    json["histograms"] = nlohmann::json::object();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &entry : counters) {
+        json["counters"][entry.first] = entry.second->get();
+    }
+    for (auto &entry : gauges) {
+        json["gauges"][entry.first] = entry.second->get();
+    }
+    for (auto &entry : histograms) {
+        const Histogram &histogram = *entry.second;
+        json["histograms"][entry.first] = {
+            {"count", histogram.getCount()},
+            {"sum", histogram.getSum()},
+            {"max", histogram.getMax()},
+            {"p50", histogram.getQuantile(0.5)},
+            {"p90", histogram.getQuantile(0.9)},
+            {"p99", histogram.getQuantile(0.99)},
+            {"p999", histogram.getQuantile(0.999)},
+        };
+    }
+    return json.dump(2);
+}
+
+bool MetricsRegistry::claimDump(bool force) {
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    int64_t last = lastDump.load(std::memory_order_relaxed);
+    if (force) {
+        lastDump = now;
+    } else if (now - last < METRICS_DUMP_PERIOD or not lastDump.compare_exchange_strong(last, now)) {
+        // Not due yet, or another thread is already writing the dump
+        return false;
+    }
+    return true;
+}
+
+void MetricsRegistry::dump(IComponentSdkBase *sdk, const std::string &filename) const {
+    std::string json = toJson();
+    auto response = sdk->writeFile(filename, {json.begin(), json.end()});
+    if (response.status != CM_OK) {
+        logError("MetricsRegistry: failed to write " + filename);
+    }
+}
@@ -0,0 +1,177 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __SKYHOOK_TRANSPORT_METRICS_H__
+#define __SKYHOOK_TRANSPORT_METRICS_H__
+
+#include <IComponentSdkBase.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Monotonically increasing count. Updates are lock-free.
+ */
+class Counter {
+public:
+    void add(uint64_t amount = 1) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+/**
+ * @brief Value that can go up and down, such as a queue depth. Updates are lock-free.
+ */
+class Gauge {
+public:
+    void set(int64_t newValue) {
+        value.store(newValue, std::memory_order_relaxed);
+    }
+    void add(int64_t amount) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+    int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value{0};
+};
+
+/**
+ * @brief Distribution of non-negative values, such as latencies in microseconds. Values are
+ * counted in log-linear buckets, four per power of two, so every recorded value is known to
+ * within 25% across the whole 64-bit range. Updates are lock-free.
+ */
+class Histogram {
+public:
+    static const int SUB_BUCKET_BITS = 2;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t value);
+
+    /**
+     * @brief Record the time elapsed since the given start time, in microseconds.
+     *
+     * @param start Start time of the operation
+     */
+    void recordSince(std::chrono::steady_clock::time_point start);
+
+    uint64_t getCount() const;
+    uint64_t getSum() const;
+    uint64_t getMax() const;
+
+    /**
+     * @brief Get an upper bound of the given quantile of the recorded values.
+     *
+     * @param quantile Quantile, between 0 and 1
+     * @return Upper bound of the bucket containing the quantile, or 0 if nothing was recorded
+     */
+    uint64_t getQuantile(double quantile) const;
+
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(int index);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
+
+/**
+ * @brief Named counters, gauges, and histograms of a component. Looking up a metric takes a lock,
+ * so hot paths should look up their metrics once and keep the reference, which stays valid for
+ * the lifetime of the registry unless the metric is removed by removeLink. Metrics that may be
+ * removed while still in use, such as those of a link, should be held through the shared
+ * handles instead, which keep them alive. Names may carry Prometheus-style labels, e.g.
+ * fetch_count{link="..."}. This class is thread-safe.
+ */
+class MetricsRegistry {
+public:
+    Counter &counter(const std::string &name);
+    Gauge &gauge(const std::string &name);
+    Histogram &histogram(const std::string &name);
+
+    std::shared_ptr<Counter> sharedCounter(const std::string &name);
+    std::shared_ptr<Gauge> sharedGauge(const std::string &name);
+    std::shared_ptr<Histogram> sharedHistogram(const std::string &name);
+
+    /**
+     * @brief Build a metric name with a link label.
+     *
+     * @param name Name of the metric
+     * @param linkId ID of the link
+     * @return Labelled name of the metric
+     */
+    static std::string linkMetric(const std::string &name, const std::string &linkId);
+
+    /**
+     * @brief Remove all metrics labelled with the given link from the registry, once the link is
+     * destroyed. Plain references to them must no longer be used, while shared handles keep them
+     * alive, no longer reported, until released.
+     *
+     * @param linkId ID of the link
+     */
+    void removeLink(const std::string &linkId);
+
+    /**
+     * @brief Get a snapshot of all metrics as JSON.
+     *
+     * @return JSON string
+     */
+    std::string toJson() const;
+
+    /**
+     * @brief Check whether at least the dump period has passed since the last dump, and if so
+     * claim the next dump. Only one of several concurrent callers gets the dump.
+     *
+     * @param force Claim the dump even if the dump period hasn't passed
+     * @return true if the caller should dump the metrics
+     */
+    bool claimDump(bool force = false);
+
+    /**
+     * @brief Write a snapshot of all metrics to the given file in the component's storage.
+     *
+     * @param sdk SDK to write the file with
+     * @param filename Name of the file
+     */
+    void dump(IComponentSdkBase *sdk, const std::string &filename) const;
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, std::shared_ptr<Counter>> counters;
+    std::map<std::string, std::shared_ptr<Gauge>> gauges;
+    std::map<std::string, std::shared_ptr<Histogram>> histograms;
+
+    std::atomic<int64_t> lastDump{0};
+};
+
+#endif  // __SKYHOOK_TRANSPORT_METRICS_H__
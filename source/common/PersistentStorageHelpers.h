@@ -50,6 +50,37 @@ bool saveValue(IComponentSdkBase *sdk, const std::string &key, T value);
 template <typename T>
 T readValue(IComponentSdkBase *sdk, const std::string &key, T defaultValue);
 
+/**
+ * @brief Save a string to persistent storage as is. The value may be retreived by passing the
+ * same key to readValue.
+ *
+ * @param sdk The sdk instance used to access persistent storage APIs
+ * @param key The key that may be used to retrieve the value
+ * @param value The value associated with the key
+ * @return true on success, false on failure
+ */
+inline bool saveValue(IComponentSdkBase *sdk, const std::string &key, const std::string &value) {
+    return sdk->writeFile(key, {value.begin(), value.end()}).status == CM_OK;
+}
+
+/**
+ * @brief Read a whole string from persistent storage. If the key is not found, return a specified
+ * default value.
+ *
+ * @param sdk The sdk instance used to access persistent storage APIs
+ * @param key The key to look up the value for
+ * @param defaultValue The value to return if the key is not found
+ * @return the found value if found, or defaultValue if not
+ */
+inline std::string readValue(IComponentSdkBase *sdk, const std::string &key,
+                             const std::string &defaultValue) {
+    std::vector<uint8_t> valueData = sdk->readFile(key);
+    if (valueData.size() == 0) {
+        return defaultValue;
+    }
+    return {valueData.begin(), valueData.end()};
+}
+
 }  // namespace psh
 
 template <typename T>
@@ -0,0 +1,128 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "RatchetStore.h"
+
+#include <openssl/sha.h>
+
+#include <iomanip>
+#include <sstream>
+
+#include "PersistentStorageHelpers.h"
+#include "log.h"
+
+// Bytes of the hash of the initial objects used in the key, enough to tell links apart
+static const int KEY_HASH_BYTES = 8;
+
+// File in a checkpoint's directory holding the checkpoint
+static const char *CHECKPOINT_FILE = "/checkpoint.json";
+
+RatchetStore::RatchetStore(IComponentSdkBase *sdk, std::chrono::milliseconds flushInterval) :
+    sdk(sdk), flushInterval(flushInterval), writerThread(&RatchetStore::runWriterThread, this) {}
+
+RatchetStore::~RatchetStore() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    conditionVariable.notify_all();
+    writerThread.join();
+    flush();
+}
+
+std::string RatchetStore::keyFor(const LinkAddress &address) {
+    std::string objUuids = address.initialFetchObjUuid + "/" + address.initialPostObjUuid;
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char *>(objUuids.c_str()), objUuids.size(), hash);
+    std::stringstream ss;
+    ss << "ratchet-";
+    for (int i = 0; i < KEY_HASH_BYTES; i++) {
+        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+    }
+    return ss.str();
+}
+
+nlohmann::json RatchetStore::load(const std::string &key) {
+    TRACE_METHOD(key);
+    std::string value;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = pending.find(key);
+        if (iter != pending.end()) {
+            value = iter->second;
+        }
+    }
+    if (value.empty()) {
+        value = psh::readValue(sdk, key + CHECKPOINT_FILE, std::string());
+    }
+    if (value.empty()) {
+        return nullptr;
+    }
+    try {
+        return nlohmann::json::parse(value);
+    } catch (nlohmann::json::exception &error) {
+        logError(logPrefix + "ignoring invalid checkpoint: " + std::string(error.what()));
+        return nullptr;
+    }
+}
+
+void RatchetStore::save(const std::string &key, const nlohmann::json &checkpoint) {
+    std::string value = checkpoint.dump();
+    std::lock_guard<std::mutex> lock(mutex);
+    pending[key] = std::move(value);
+}
+
+void RatchetStore::erase(const std::string &key) {
+    TRACE_METHOD(key);
+    // Wait out a flush that may be writing the checkpoint, so it isn't written back afterwards
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.erase(key);
+    }
+    if (sdk->removeDir(key).status != CM_OK) {
+        logError(logPrefix + "failed to delete checkpoint");
+    }
+}
+
+void RatchetStore::flush() {
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+    std::map<std::string, std::string> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pending);
+    }
+    for (auto &entry : batch) {
+        sdk->makeDir(entry.first);
+        if (not psh::saveValue(sdk, entry.first + CHECKPOINT_FILE, entry.second)) {
+            logError("RatchetStore: failed to write " + entry.first);
+        }
+    }
+}
+
+void RatchetStore::runWriterThread() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (not stopping) {
+        conditionVariable.wait_for(lock, flushInterval, [this] { return stopping; });
+        if (pending.empty()) {
+            continue;
+        }
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
@@ -0,0 +1,103 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_RATCHET_STORE_H__
+#define __SKYHOOK_TRANSPORT_RATCHET_STORE_H__
+
+#include <IComponentSdkBase.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+
+#include "LinkAddress.h"
+
+// Longest time a checkpoint waits to be written
+const std::chrono::milliseconds RATCHET_FLUSH_INTERVAL(1000);
+
+/**
+ * @brief Persistent checkpoints of the ratchet positions of links, so that a restarted node
+ * resumes its links where they left off. Checkpoints are written behind: saving one only replaces
+ * the link's pending checkpoint, and a writer thread writes the pending checkpoints of all links
+ * in one batch every flush interval, and on destruction. Each checkpoint is kept in a directory of
+ * its own, the only thing the SDK can delete. This class is thread-safe.
+ */
+class RatchetStore {
+public:
+    explicit RatchetStore(IComponentSdkBase *sdk,
+                          std::chrono::milliseconds flushInterval = RATCHET_FLUSH_INTERVAL);
+    ~RatchetStore();
+
+    /**
+     * @brief Get the storage key of a link's checkpoint, the directory it is kept in. It is
+     * derived from the link's initial objects, which are unique to the link and the same every
+     * time it is loaded.
+     *
+     * @param address Address of the link, as seen from this end
+     * @return Key of the checkpoint
+     */
+    static std::string keyFor(const LinkAddress &address);
+
+    /**
+     * @brief Read a link's checkpoint, or the checkpoint still waiting to be written.
+     *
+     * @param key Key of the checkpoint
+     * @return The checkpoint, or null if there is none
+     */
+    nlohmann::json load(const std::string &key);
+
+    /**
+     * @brief Queue a link's checkpoint to be written, replacing any still waiting.
+     *
+     * @param key Key of the checkpoint
+     * @param checkpoint The checkpoint
+     */
+    void save(const std::string &key, const nlohmann::json &checkpoint);
+
+    /**
+     * @brief Delete a link's checkpoint, including one still waiting to be written, once the link
+     * is destroyed for good.
+     *
+     * @param key Key of the checkpoint
+     */
+    void erase(const std::string &key);
+
+    /**
+     * @brief Write all checkpoints waiting to be written.
+     */
+    void flush();
+
+private:
+    void runWriterThread();
+
+    IComponentSdkBase *sdk;
+    std::chrono::milliseconds flushInterval;
+
+    std::mutex mutex;
+    // Serializes writes, so that a flush can't overtake an earlier one still writing
+    std::mutex writeMutex;
+    std::condition_variable conditionVariable;
+    std::map<std::string, std::string> pending;
+    bool stopping{false};
+    std::thread writerThread;
+};
+
+#endif  // __SKYHOOK_TRANSPORT_RATCHET_STORE_H__
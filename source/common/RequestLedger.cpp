@@ -0,0 +1,214 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "RequestLedger.h"
+
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+#include "log.h"
+
+static const double HOURS_PER_MONTH = 730.0;
+static const double MICRO = 1000000.0;
+
+static thread_local const std::string *currentLedgerLink = nullptr;
+
+const char *s3RequestTypeToString(S3RequestType type) {
+    switch (type) {
+        case S3_REQUEST_GET:
+            return "get";
+        case S3_REQUEST_PUT:
+            return "put";
+        case S3_REQUEST_POLICY_WRITE:
+            return "policy_write";
+        case S3_REQUEST_BUCKET_WRITE:
+            return "bucket_write";
+        case S3_REQUEST_DELETE_OBJECT:
+            return "delete_object";
+        case S3_REQUEST_DELETE_BUCKET:
+            return "delete_bucket";
+        default:
+            return "invalid";
+    }
+}
+
+RequestLedger::RequestLedger(S3RequestPricing pricing_) :
+    pricing(pricing_), created(std::chrono::steady_clock::now()) {}
+
+int64_t RequestLedger::minuteOf(std::chrono::steady_clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::minutes>(time - created).count();
+}
+
+double RequestLedger::costOf(const Counts &counts) const {
+    double cost = 0;
+    for (int type = 0; type < S3_REQUEST_TYPE_COUNT; ++type) {
+        cost += counts[type] * pricing.usdPer1000[type] / 1000.0;
+    }
+    return cost;
+}
+
+void RequestLedger::record(S3RequestType type, const std::string &bucket, uint64_t count) {
+    int64_t minute = minuteOf(std::chrono::steady_clock::now());
+    std::string linkId = currentLedgerLink != nullptr ? *currentLedgerLink : "";
+
+    std::lock_guard<std::mutex> lock(mutex);
+    requests[{linkId, bucket}][type] += count;
+    totals[type] += count;
+    Slot &slot = recent[minute % recent.size()];
+    if (slot.minute != minute) {
+        slot.minute = minute;
+        slot.counts = {};
+    }
+    slot.counts[type] += count;
+}
+
+void RequestLedger::removeLink(const std::string &linkId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = requests.lower_bound({linkId, ""});
+    while (iter != requests.end() and std::get<0>(iter->first) == linkId) {
+        Counts &destroyed = requests[{LEDGER_DESTROYED_LINK, std::get<1>(iter->first)}];
+        for (int type = 0; type < S3_REQUEST_TYPE_COUNT; ++type) {
+            destroyed[type] += iter->second[type];
+        }
+        iter = requests.erase(iter);
+    }
+}
+
+RequestLedger::Projection RequestLedger::project() const {
+    auto now = std::chrono::steady_clock::now();
+    int64_t minute = minuteOf(now);
+    // The window is the last few whole minutes and the current partial one, or the ledger's whole
+    // lifetime if it is younger than that
+    int64_t firstMinute = std::max<int64_t>(minute - static_cast<int64_t>(recent.size()) + 1, 0);
+    auto windowStart = created + std::chrono::minutes(firstMinute);
+    double windowSeconds =
+        std::max(std::chrono::duration<double>(now - windowStart).count(), 1.0);
+
+    Counts counts{};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &slot : recent) {
+            if (slot.minute >= firstMinute and slot.minute <= minute) {
+                for (int type = 0; type < S3_REQUEST_TYPE_COUNT; ++type) {
+                    counts[type] += slot.counts[type];
+                }
+            }
+        }
+    }
+
+    Projection projection{};
+    projection.window = std::chrono::seconds(static_cast<int64_t>(windowSeconds));
+    double hoursInWindow = windowSeconds / 3600.0;
+    for (int type = 0; type < S3_REQUEST_TYPE_COUNT; ++type) {
+        projection.requestsPerHour[type] = counts[type] / hoursInWindow;
+        projection.totalRequestsPerHour += projection.requestsPerHour[type];
+    }
+    projection.usdPerHour = costOf(counts) / hoursInWindow;
+    projection.usdPerMonth = projection.usdPerHour * HOURS_PER_MONTH;
+    return projection;
+}
+
+double RequestLedger::totalCost() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return costOf(totals);
+}
+
+void RequestLedger::updateMetrics(MetricsRegistry &metrics) const {
+    Projection projection = project();
+    metrics.gauge("s3_projected_requests_per_hour")
+        .set(static_cast<int64_t>(projection.totalRequestsPerHour));
+    metrics.gauge("s3_projected_cost_per_month_microusd")
+        .set(static_cast<int64_t>(projection.usdPerMonth * MICRO));
+    metrics.gauge("s3_cost_microusd").set(static_cast<int64_t>(totalCost() * MICRO));
+}
+
+std::string RequestLedger::toJson() const {
+    auto countsToJson = [this](const Counts &counts) {
+        nlohmann::json json = nlohmann::json::object();
+        for (int type = 0; type < S3_REQUEST_TYPE_COUNT; ++type) {
+            if (counts[type] != 0) {
+                json[s3RequestTypeToString(static_cast<S3RequestType>(type))] = counts[type];
+            }
+        }
+        json["cost_usd"] = costOf(counts);
+        return json;
+    };
+
+    Counts totalCounts;
+    std::map<std::string, Counts> byLink;
+    std::map<std::string, Counts> byBucket;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        totalCounts = totals;
+        for (auto &entry : requests) {
+            Counts &link = byLink[std::get<0>(entry.first)];
+            Counts &bucket = byBucket[std::get<1>(entry.first)];
+            for (int type = 0; type < S3_REQUEST_TYPE_COUNT; ++type) {
+                link[type] += entry.second[type];
+                bucket[type] += entry.second[type];
+            }
+        }
+    }
+
+    nlohmann::json json;
+    json["total"] = countsToJson(totalCounts);
+    json["by_link"] = nlohmann::json::object();
+    for (auto &entry : byLink) {
+        // Requests outside any link, such as creating the transport's buckets
+        json["by_link"][entry.first.empty() ? "(none)" : entry.first] = countsToJson(entry.second);
+    }
+    json["by_bucket"] = nlohmann::json::object();
+    for (auto &entry : byBucket) {
+        json["by_bucket"][entry.first] = countsToJson(entry.second);
+    }
+
+    Projection projection = project();
+    nlohmann::json requestsPerHour = nlohmann::json::object();
+    nlohmann::json price = nlohmann::json::object();
+    for (int type = 0; type < S3_REQUEST_TYPE_COUNT; ++type) {
+        const char *name = s3RequestTypeToString(static_cast<S3RequestType>(type));
+        requestsPerHour[name] = projection.requestsPerHour[type];
+        price[name] = pricing.usdPer1000[type];
+    }
+    json["projection"] = {
+        {"window_s", projection.window.count()},
+        {"requests_per_hour", requestsPerHour},
+        {"total_requests_per_hour", projection.totalRequestsPerHour},
+        {"requests_per_second", projection.totalRequestsPerHour / 3600.0},
+        {"cost_per_hour_usd", projection.usdPerHour},
+        {"cost_per_month_usd", projection.usdPerMonth},
+    };
+    json["pricing_usd_per_1000"] = price;
+    return json.dump(2);
+}
+
+void RequestLedger::dump(IComponentSdkBase *sdk, const std::string &filename) const {
+    std::string json = toJson();
+    auto response = sdk->writeFile(filename, {json.begin(), json.end()});
+    if (response.status != CM_OK) {
+        logError("RequestLedger: failed to write " + filename);
+    }
+}
+
+RequestLedger::LinkScope::LinkScope(const std::string &linkId_) :
+    previous(currentLedgerLink), linkId(linkId_) {
+    currentLedgerLink = &linkId;
+}
+
+RequestLedger::LinkScope::~LinkScope() {
+    currentLedgerLink = previous;
+}
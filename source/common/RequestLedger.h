@@ -0,0 +1,176 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_REQUEST_LEDGER_H__
+#define __SKYHOOK_TRANSPORT_REQUEST_LEDGER_H__
+
+#include <IComponentSdkBase.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "Metrics.h"
+
+// Number of most recent minutes of requests the cost projection is based on
+const size_t LEDGER_PROJECTION_MINUTES = 10;
+
+// Link the requests of destroyed links are folded into
+const char *const LEDGER_DESTROYED_LINK = "(destroyed)";
+
+/**
+ * @brief Kinds of S3 request, grouped by how they are billed
+ */
+enum S3RequestType {
+    S3_REQUEST_GET,
+    S3_REQUEST_PUT,
+    S3_REQUEST_POLICY_WRITE,
+    // CreateBucket and PutPublicAccessBlock
+    S3_REQUEST_BUCKET_WRITE,
+    S3_REQUEST_DELETE_OBJECT,
+    S3_REQUEST_DELETE_BUCKET,
+    S3_REQUEST_TYPE_COUNT
+};
+
+const char *s3RequestTypeToString(S3RequestType type);
+
+/**
+ * @brief Price of each kind of request in USD per 1000 requests. The defaults are S3 Standard in
+ * us-east-1: GETs are billed at the GET rate, everything that writes at the PUT rate, and deletes
+ * are free.
+ */
+struct S3RequestPricing {
+    std::array<double, S3_REQUEST_TYPE_COUNT> usdPer1000{0.0004, 0.005, 0.005, 0.005, 0.0, 0.0};
+};
+
+/**
+ * @brief Ledger of the billable S3 requests made by a transport, by kind, link and bucket, with a
+ * projection of the request rate and cost from the requests of the last few minutes. The bucket
+ * owner pays for the requests of both ends of a link, so the account holder's bill is the sum of
+ * the ledgers of both.
+ *
+ * Requests are attributed to the link set for the calling thread with LinkScope, or to no link
+ * for transport-wide requests. This class is thread-safe.
+ */
+class RequestLedger {
+public:
+    explicit RequestLedger(S3RequestPricing pricing = {});
+
+    /**
+     * @brief Record requests made on behalf of the current link, whether they succeeded or not.
+     *
+     * @param type Kind of request
+     * @param bucket Bucket the requests were made to
+     * @param count Number of requests
+     */
+    void record(S3RequestType type, const std::string &bucket, uint64_t count = 1);
+
+    /**
+     * @brief Fold the requests of a destroyed link into LEDGER_DESTROYED_LINK, keeping them by
+     * bucket, so that the ledger doesn't grow with every link ever created.
+     *
+     * @param linkId ID of the link
+     */
+    void removeLink(const std::string &linkId);
+
+    struct Projection {
+        // Length of the recent period the projection is based on
+        std::chrono::seconds window;
+        std::array<double, S3_REQUEST_TYPE_COUNT> requestsPerHour;
+        double totalRequestsPerHour;
+        double usdPerHour;
+        double usdPerMonth;
+    };
+
+    /**
+     * @brief Project the hourly and monthly requests and cost from the current request rate.
+     *
+     * @return The projection
+     */
+    Projection project() const;
+
+    /**
+     * @brief Get the total cost of the requests recorded so far.
+     *
+     * @return Cost in USD
+     */
+    double totalCost() const;
+
+    /**
+     * @brief Publish the projection as gauges in the given registry.
+     *
+     * @param metrics Registry to set the gauges in
+     */
+    void updateMetrics(MetricsRegistry &metrics) const;
+
+    /**
+     * @brief Get the requests and their cost by kind, link and bucket, and the projection, as JSON.
+     *
+     * @return JSON string
+     */
+    std::string toJson() const;
+
+    /**
+     * @brief Write the ledger to the given file in the component's storage.
+     *
+     * @param sdk SDK to write the file with
+     * @param filename Name of the file
+     */
+    void dump(IComponentSdkBase *sdk, const std::string &filename) const;
+
+    /**
+     * @brief Attributes the requests recorded by this thread to a link for as long as it is in
+     * scope.
+     */
+    class LinkScope {
+    public:
+        explicit LinkScope(const std::string &linkId);
+        ~LinkScope();
+        LinkScope(const LinkScope &) = delete;
+        LinkScope &operator=(const LinkScope &) = delete;
+
+    private:
+        const std::string *previous;
+        std::string linkId;
+    };
+
+private:
+    using Counts = std::array<uint64_t, S3_REQUEST_TYPE_COUNT>;
+    // Requests in one minute, for the projection
+    struct Slot {
+        int64_t minute{-1};
+        Counts counts{};
+    };
+
+    int64_t minuteOf(std::chrono::steady_clock::time_point time) const;
+    double costOf(const Counts &counts) const;
+
+    S3RequestPricing pricing;
+    std::chrono::steady_clock::time_point created;
+
+    mutable std::mutex mutex;
+    // Requests by link and bucket, of which the totals are the sum
+    std::map<std::tuple<std::string, std::string>, Counts> requests;
+    Counts totals{};
+    std::array<Slot, LEDGER_PROJECTION_MINUTES> recent;
+};
+
+#endif  // __SKYHOOK_TRANSPORT_REQUEST_LEDGER_H__
@@ -0,0 +1,47 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "RetryBackoff.h"
+
+#include <algorithm>
+#include <random>
+
+// Delay used for throttling responses that don't say how long to wait
+static const std::chrono::milliseconds MIN_THROTTLE_DELAY(1000);
+
+RetryBackoff::RetryBackoff(std::chrono::milliseconds base, std::chrono::milliseconds cap) :
+    base(base), cap(cap) {}
+
+std::chrono::milliseconds RetryBackoff::delay(int tries, std::chrono::milliseconds retryAfter) const {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+
+    // Avoid overflowing the shift, the cap is reached long before this anyway
+    int exponent = std::min(std::max(tries - 1, 0), 20);
+    auto ceiling = std::min(cap, std::chrono::milliseconds(base.count() * (1LL << exponent)));
+    std::uniform_int_distribution<long long> distribution(0, ceiling.count());
+    auto jittered = std::chrono::milliseconds(distribution(generator));
+
+    return std::max(jittered, retryAfter);
+}
+
+std::chrono::milliseconds RetryBackoff::parseRetryAfter(const std::string &headerValue) {
+    try {
+        return std::max(std::chrono::milliseconds(std::chrono::seconds(std::stol(headerValue))),
+                        MIN_THROTTLE_DELAY);
+    } catch (std::exception &) {
+        return MIN_THROTTLE_DELAY;
+    }
+}
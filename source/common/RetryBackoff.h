@@ -0,0 +1,56 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_RETRY_BACKOFF_H__
+#define __SKYHOOK_TRANSPORT_RETRY_BACKOFF_H__
+
+#include <chrono>
+#include <string>
+
+/**
+ * @brief Jittered exponential backoff for retrying failed S3 requests.
+ */
+class RetryBackoff {
+public:
+    RetryBackoff(std::chrono::milliseconds base = std::chrono::milliseconds(250),
+                 std::chrono::milliseconds cap = std::chrono::seconds(30));
+
+    /**
+     * @brief Get the delay before the next attempt. The delay is drawn uniformly from zero to
+     * base * 2^(tries - 1), capped, ("full jitter") but is never shorter than the delay requested
+     * by the server. This function is thread-safe.
+     *
+     * @param tries Number of attempts made so far
+     * @param retryAfter Delay requested by the server (e.g. S3 SlowDown), or zero
+     * @return The delay
+     */
+    std::chrono::milliseconds delay(int tries, std::chrono::milliseconds retryAfter) const;
+
+    /**
+     * @brief Parse the value of a Retry-After header. Only the delay-seconds form is supported.
+     * Throttling responses without a usable header get a minimum delay.
+     *
+     * @param headerValue Value of the header, possibly empty
+     * @return The requested delay
+     */
+    static std::chrono::milliseconds parseRetryAfter(const std::string &headerValue);
+
+private:
+    std::chrono::milliseconds base;
+    std::chrono::milliseconds cap;
+};
+
+#endif  // __SKYHOOK_TRANSPORT_RETRY_BACKOFF_H__
@@ -28,6 +28,10 @@
 #include <openssl/sha.h>
 #include <openssl/rand.h>
 
+// File in the transport's storage directory that metrics are periodically written to
+static const char *METRICS_FILE = "transport-metrics.json";
+static const char *TRACE_FILE = "transport-trace.json";
+static const char *REQUEST_LEDGER_FILE = "transport-requests.json";
 
 std::string skyhookRoleToString(SkyhookRole skyhookRole) {
     switch (skyhookRole) {
@@ -95,6 +99,8 @@ LinkProperties createDefaultLinkProperties(const ChannelProperties &channelPrope
 }
 
 SkyhookTransport::SkyhookTransport(ITransportSdk *sdk, const std::string &roleName) :
+    tracer(sdk->getActivePersona()),
+    ratchetStore(sdk),
     sdk(sdk),
     racePersona(sdk->getActivePersona()),
     channelProperties(sdk->getChannelProperties()),
@@ -105,7 +111,10 @@ SkyhookTransport::SkyhookTransport(ITransportSdk *sdk, const std::string &roleNa
     regionReqHandle(sdk->requestPluginUserInput("region", "What AWS region is the S3 bucket located in?", true).handle),
     bucketReqHandle(sdk->requestPluginUserInput("bucket", "What is the name of the S3 bucket?", true).handle),
     seedReqHandle(sdk->requestPluginUserInput("seed", "Enter a random string", true).handle),
-    singleReceiveReqHandle(sdk->requestPluginUserInput("singleReceive", "Should there be a singleReceive link for supporting multiple clients? (e.g. a Skyhook link address will be publicly distributed)", true).handle) {}
+    singleReceiveReqHandle(sdk->requestPluginUserInput("singleReceive", "Should there be a singleReceive link for supporting multiple clients? (e.g. a Skyhook link address will be publicly distributed)", true).handle),
+    maxQueuedBytesReqHandle(sdk->requestPluginUserInput("maxQueuedBytes", "Maximum number of bytes of outbound content to queue across all links (default 64 MiB)", true).handle),
+    traceSampleRateReqHandle(sdk->requestPluginUserInput("traceSampleRate", "Fraction of packages to trace, between 0 and 1 (default 0)", true).handle),
+    logLevelReqHandle(sdk->requestPluginUserInput("logLevel", "Minimum level of messages to log: trace, debug, info, warning, or error (default info, or as built)", true).handle) {}
 
 
 void SkyhookTransport::handleUserInputResponse(RaceHandle handle, bool answered,
@@ -144,6 +153,35 @@ void SkyhookTransport::handleUserInputResponse(RaceHandle handle, bool answered,
         firstCreatedIsSingleReceive = false;
       }
     }
+    if (handle == maxQueuedBytesReqHandle) {
+      maxQueuedBytesReqHandle = NULL_RACE_HANDLE;
+      if (answered) {
+        try {
+          contentBudget.setLimit(std::stoull(response));
+        } catch (std::exception &error) {
+          logError(logPrefix + "invalid maxQueuedBytes '" + response + "', using default");
+        }
+      }
+    }
+    if (handle == traceSampleRateReqHandle) {
+      traceSampleRateReqHandle = NULL_RACE_HANDLE;
+      if (answered) {
+        try {
+          tracer.setSampleRate(std::stod(response));
+        } catch (std::exception &error) {
+          logError(logPrefix + "invalid traceSampleRate '" + response + "', tracing disabled");
+        }
+      }
+    }
+    if (handle == logLevelReqHandle) {
+      logLevelReqHandle = NULL_RACE_HANDLE;
+      int level;
+      if (answered and parseLogLevel(response, level)) {
+        setLogLevel(level);
+      } else if (answered) {
+        logError(logPrefix + "invalid logLevel '" + response + "', using default");
+      }
+    }
 }
 
 ComponentStatus SkyhookTransport::onUserInputReceived(RaceHandle handle, bool answered,
@@ -151,7 +189,10 @@ ComponentStatus SkyhookTransport::onUserInputReceived(RaceHandle handle, bool an
     TRACE_METHOD(handle, answered, response);
     handleUserInputResponse(handle, answered, response);
     // if (!bucket.empty() and !region.empty() and !seed.empty()) 
-    if (regionReqHandle == NULL_RACE_HANDLE and
+    // Tuning knobs such as maxQueuedBytes, traceSampleRate, and logLevel keep their defaults until
+    // answered, so they don't hold up starting
+    if (not ready and
+        regionReqHandle == NULL_RACE_HANDLE and
         bucketReqHandle == NULL_RACE_HANDLE and
         seedReqHandle == NULL_RACE_HANDLE and
         singleReceiveReqHandle == NULL_RACE_HANDLE) {
@@ -225,7 +266,7 @@ ComponentStatus SkyhookTransport::postLinkCreate(const std::string &logPrefix,
     logInfo(logPrefix + "adding link");
     links.add(link);
     logInfo(logPrefix + "updating status " + std::to_string(linkStatus));
-    sdk->onLinkStatusChanged(handle, linkId, linkStatus, {});
+    sdk->onLinkStatusChanged(handle, linkId, linkStatus, link->getUserModelParameters());
 
     return COMPONENT_OK;
 }
@@ -246,9 +287,13 @@ ComponentStatus SkyhookTransport::createLink(RaceHandle handle, const LinkID &li
     LinkAddress address;
     address.region = region;
     address.fetchBucket = bucket;
-    address.initialFetchObjUuid = Link::generateNextObjUuid("fetch" + seed);
+    // The link ID is mixed in so that links created from the same seed don't share objects
+    address.initialFetchObjUuid = Link::generateNextObjUuid("fetch" + seed + linkId);
     address.postBucket = bucket;
-    address.initialPostObjUuid = Link::generateNextObjUuid("post" + seed);
+    address.initialPostObjUuid = Link::generateNextObjUuid("post" + seed + linkId);
+    // Probing ahead multiplies the GET requests of every fetch, so created links leave lookahead
+    // off and it is only used by addresses that ask for it
+    address.drainLimit = DEFAULT_DRAIN_LIMIT;
 
     // First createLink and singleReceive is specified, so make it singleReceive just this once then never on subsequent links
     if (firstCreatedIsSingleReceive) {
@@ -292,6 +337,20 @@ ComponentStatus SkyhookTransport::loadLinkAddresses(
     return COMPONENT_ERROR;
 }
 
+void SkyhookTransport::dumpMetrics(bool force) {
+    if (not metrics.claimDump(force)) {
+        return;
+    }
+    metrics.gauge("content_budget_usage_bytes").set(contentBudget.getUsage());
+    metrics.gauge("link_count").set(links.size());
+    requestLedger.updateMetrics(metrics);
+    metrics.dump(sdk, METRICS_FILE);
+    requestLedger.dump(sdk, REQUEST_LEDGER_FILE);
+    if (tracer.isEnabled()) {
+        tracer.dump(sdk, TRACE_FILE);
+    }
+}
+
 ComponentStatus SkyhookTransport::createLinkFromAddress(
     RaceHandle handle, const LinkID &linkId, const std::string &linkAddress) {
     TRACE_METHOD(handle, linkId, linkAddress);
@@ -317,6 +376,14 @@ ComponentStatus SkyhookTransport::destroyLink(RaceHandle handle, const LinkID &l
     }
 
     link->shutdown();
+    link->eraseCheckpoint();
+    // Give up the objects and buckets only here, tearing down the transport keeps them for the
+    // link to be restored
+    link->releaseObjects();
+    // Keep the final counts of the link, then stop carrying them in every dump
+    dumpMetrics(true);
+    metrics.removeLink(linkId);
+    requestLedger.removeLink(linkId);
 
     return COMPONENT_OK;
 }
@@ -400,6 +467,8 @@ ComponentStatus SkyhookTransport::dequeueContent(const Action &action) {
 ComponentStatus SkyhookTransport::doAction(const std::vector<RaceHandle> &handles,
                                                        const Action &action) {
     TRACE_METHOD(handles, action.actionId);
+    // Actions are done regularly, so piggyback the periodic metrics dump on them
+    dumpMetrics(false);
 
     try {
         ActionJson actionParams = nlohmann::json::parse(action.json);
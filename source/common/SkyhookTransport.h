@@ -24,7 +24,12 @@
 
 #include <atomic>
 
+#include "ContentBudget.h"
 #include "LinkMap.h"
+#include "Metrics.h"
+#include "RatchetStore.h"
+#include "RequestLedger.h"
+#include "Tracing.h"
 
 enum SkyhookRole {
     BR_UNDEF = 0,
@@ -70,6 +75,25 @@ public:
     virtual ComponentStatus doAction(const std::vector<RaceHandle> &handles,
                                      const Action &action) override;
 
+    // Metrics of the transport and its links. Declared first so that it outlives everything that
+    // holds references to its metrics.
+    MetricsRegistry metrics;
+
+    // Traces of sampled posts and fetches, written alongside the metrics. Declared before the
+    // links, which add spans to it.
+    Tracer tracer;
+
+    // Billable S3 requests made by the transport and its links, written alongside the metrics
+    RequestLedger requestLedger;
+
+    // Checkpoints of the links' ratchet positions. Declared before the links, which save their
+    // final positions on shutdown.
+    RatchetStore ratchetStore;
+
+    // Memory budget for content queued on all links. Declared before the links so that it
+    // outlives any content buffers they hold.
+    ContentBudget contentBudget;
+
     // virtual bool makeObjPuttable(const std::string &uuid, const std::string &bucket);
   
     // TODO make unPUT/GETable
@@ -83,6 +107,14 @@ protected:
                                                      bool isCreator);
     virtual std::string generateRandomString(int byteSsize);
 
+    /**
+     * @brief Write the transport's metrics, its request ledger, and its traces if tracing is
+     * enabled, to its storage directory if a dump is due.
+     *
+     * @param force Write the metrics even if a dump isn't due yet
+     */
+    virtual void dumpMetrics(bool force);
+
     ITransportSdk *sdk;
     std::string racePersona;
     ChannelProperties channelProperties;
@@ -104,6 +136,9 @@ protected:
     RaceHandle bucketReqHandle;
     RaceHandle seedReqHandle;
     RaceHandle singleReceiveReqHandle;
+    RaceHandle maxQueuedBytesReqHandle;
+    RaceHandle traceSampleRateReqHandle;
+    RaceHandle logLevelReqHandle;
     std::string region;
     std::string bucket;
     std::string seed;
@@ -0,0 +1,193 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "Tracing.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "log.h"
+
+// Chrome trace events take microsecond timestamps
+using TraceMicros = std::chrono::microseconds;
+
+static thread_local const TraceContext *currentTraceContext = nullptr;
+
+static uint64_t leadingBits(const std::string &objUuid) {
+    // Object UUIDs are SHA256 hex digests, so their leading bits are uniformly distributed
+    try {
+        return std::stoull(objUuid.substr(0, 16), nullptr, 16);
+    } catch (std::exception &) {
+        return std::hash<std::string>{}(objUuid);
+    }
+}
+
+Tracer::Tracer(const std::string &processName_, size_t capacity_) :
+    processName(processName_),
+    processId(std::hash<std::string>{}(processName_) & 0x7fffffff),
+    capacity(capacity_) {
+    auto system = std::chrono::duration_cast<TraceMicros>(std::chrono::system_clock::now().time_since_epoch());
+    auto steady = std::chrono::duration_cast<TraceMicros>(std::chrono::steady_clock::now().time_since_epoch());
+    wallClockOffset = system - steady;
+}
+
+void Tracer::setSampleRate(double rate) {
+    uint64_t threshold = 0;
+    if (rate >= 1.0) {
+        threshold = UINT64_MAX;
+    } else if (rate > 0.0) {
+        threshold = static_cast<uint64_t>(rate * static_cast<double>(UINT64_MAX));
+    }
+    sampleThreshold = threshold;
+}
+
+bool Tracer::isEnabled() const {
+    return sampleThreshold != 0;
+}
+
+bool Tracer::isSampled(const std::string &objUuid) const {
+    uint64_t threshold = sampleThreshold;
+    if (threshold == 0) {
+        return false;
+    }
+    return threshold == UINT64_MAX or leadingBits(objUuid) < threshold;
+}
+
+int64_t Tracer::toMicroseconds(std::chrono::steady_clock::time_point time) const {
+    return (std::chrono::duration_cast<TraceMicros>(time.time_since_epoch()) + wallClockOffset).count();
+}
+
+uint64_t Tracer::threadId(const std::string &linkId) {
+    // Must hold the mutex. Each link is shown as a thread of the process.
+    uint64_t tid = std::hash<std::string>{}(linkId) & 0x7fffffff;
+    if (namedLinks.insert(linkId).second) {
+        events.push_back({{"ph", "M"},
+                          {"name", "thread_name"},
+                          {"pid", processId},
+                          {"tid", tid},
+                          {"args", {{"name", linkId}}}});
+    }
+    return tid;
+}
+
+void Tracer::addEvent(nlohmann::json event) {
+    // Must hold the mutex
+    if (events.size() >= capacity) {
+        events.pop_front();
+        ++droppedEvents;
+    }
+    events.push_back(std::move(event));
+}
+
+void Tracer::addSpan(const TraceContext &context, const char *name, const char *category,
+                     std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end, nlohmann::json args) {
+    args["actionId"] = context.actionId;
+    args["objUuid"] = context.objUuid;
+    if (not context.handles.empty()) {
+        args["handles"] = context.handles;
+    }
+    int64_t ts = toMicroseconds(start);
+    int64_t dur = std::max<int64_t>(toMicroseconds(end) - ts, 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t tid = threadId(context.linkId);
+    addEvent({{"ph", "X"},
+              {"name", name},
+              {"cat", category},
+              {"pid", processId},
+              {"tid", tid},
+              {"ts", ts},
+              {"dur", dur},
+              {"args", std::move(args)}});
+}
+
+void Tracer::addFlow(const TraceContext &context, bool post, std::chrono::steady_clock::time_point at) {
+    // The post and fetch of an object share the flow ID, whichever node they happen on
+    uint64_t flowId = leadingBits(context.objUuid) >> 12;
+    // Bind to the enclosing span by starting just before it ends
+    int64_t ts = toMicroseconds(at) - 1;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t tid = threadId(context.linkId);
+    nlohmann::json event = {{"ph", post ? "s" : "f"},
+                            {"name", "delivery"},
+                            {"cat", "flow"},
+                            {"id", flowId},
+                            {"pid", processId},
+                            {"tid", tid},
+                            {"ts", ts}};
+    if (not post) {
+        event["bp"] = "e";
+    }
+    addEvent(std::move(event));
+}
+
+std::string Tracer::toJson() const {
+    nlohmann::json traceEvents = nlohmann::json::array();
+    traceEvents.push_back({{"ph", "M"},
+                           {"name", "process_name"},
+                           {"pid", processId},
+                           {"args", {{"name", processName}}}});
+
+    uint64_t dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &event : events) {
+            traceEvents.push_back(event);
+        }
+        dropped = droppedEvents;
+    }
+
+    nlohmann::json json = {{"traceEvents", std::move(traceEvents)},
+                           {"displayTimeUnit", "ms"},
+                           {"otherData", {{"droppedEvents", dropped}}}};
+    return json.dump();
+}
+
+void Tracer::dump(IComponentSdkBase *sdk, const std::string &filename) const {
+    std::string json = toJson();
+    auto response = sdk->writeFile(filename, {json.begin(), json.end()});
+    if (response.status != CM_OK) {
+        logError("Tracer: failed to write " + filename);
+    }
+}
+
+ActiveTraceContext::ActiveTraceContext(const TraceContext *context) : previous(currentTraceContext) {
+    currentTraceContext = context;
+}
+
+ActiveTraceContext::~ActiveTraceContext() {
+    currentTraceContext = previous;
+}
+
+const TraceContext *ActiveTraceContext::get() {
+    return currentTraceContext;
+}
+
+TraceSpan::TraceSpan(const char *name_, const char *category_) :
+    context(currentTraceContext), name(name_), category(category_) {
+    if (context != nullptr) {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (context != nullptr) {
+        context->tracer->addSpan(*context, name, category, start, std::chrono::steady_clock::now());
+    }
+}
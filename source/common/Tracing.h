@@ -0,0 +1,181 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_TRANSPORT_TRACING_H__
+#define __SKYHOOK_TRANSPORT_TRACING_H__
+
+#include <IComponentSdkBase.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Most trace events kept in memory, the oldest are dropped beyond this
+const size_t DEFAULT_TRACE_CAPACITY = 100000;
+
+class Tracer;
+
+/**
+ * @brief The operation a span belongs to: the link, the action and the object it is transferring.
+ */
+struct TraceContext {
+    Tracer *tracer;
+    std::string linkId;
+    uint64_t actionId;
+    std::string objUuid;
+    std::vector<RaceHandle> handles;
+};
+
+/**
+ * @brief Spans of the posts and fetches of a transport's links, kept in memory and exported in
+ * the Chrome trace-event format (chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Operations are sampled by the object they transfer, so the sender's post of an object and the
+ * receiver's fetch of it are either both traced or both not, as long as both ends use the same
+ * sample rate. The post and the fetch are joined by a flow event, so merging the traces of both
+ * ends shows the whole delivery. This class is thread-safe.
+ */
+class Tracer {
+public:
+    /**
+     * @param processName Name the events of this tracer are grouped under, e.g. the persona
+     * @param capacity Most events kept in memory
+     */
+    explicit Tracer(const std::string &processName, size_t capacity = DEFAULT_TRACE_CAPACITY);
+
+    /**
+     * @brief Set the fraction of objects whose operations are traced. 0 disables tracing.
+     *
+     * @param rate Sample rate, between 0 and 1
+     */
+    void setSampleRate(double rate);
+
+    bool isEnabled() const;
+
+    /**
+     * @brief Check whether operations on the given object are traced.
+     *
+     * @param objUuid UUID of the object
+     * @return true if the object is sampled
+     */
+    bool isSampled(const std::string &objUuid) const;
+
+    /**
+     * @brief Add a span of an operation.
+     *
+     * @param context Operation the span belongs to
+     * @param name Name of the span, e.g. "queue_wait"
+     * @param category Category of the span, e.g. "link" or "s3"
+     * @param start Start of the span
+     * @param end End of the span
+     * @param args Additional arguments shown with the span
+     */
+    void addSpan(const TraceContext &context, const char *name, const char *category,
+                 std::chrono::steady_clock::time_point start,
+                 std::chrono::steady_clock::time_point end,
+                 nlohmann::json args = nlohmann::json::object());
+
+    /**
+     * @brief Add one end of the flow from the post of an object to its fetch. It is bound to the
+     * span of the operation that ends at the given time.
+     *
+     * @param context Operation posting or fetching the object
+     * @param post true for the post, false for the fetch
+     * @param at End of the operation's span
+     */
+    void addFlow(const TraceContext &context, bool post, std::chrono::steady_clock::time_point at);
+
+    /**
+     * @brief Get all events in the Chrome trace-event JSON format.
+     *
+     * @return JSON string
+     */
+    std::string toJson() const;
+
+    /**
+     * @brief Write all events to the given file in the component's storage.
+     *
+     * @param sdk SDK to write the file with
+     * @param filename Name of the file
+     */
+    void dump(IComponentSdkBase *sdk, const std::string &filename) const;
+
+private:
+    int64_t toMicroseconds(std::chrono::steady_clock::time_point time) const;
+    uint64_t threadId(const std::string &linkId);
+    void addEvent(nlohmann::json event);
+
+    std::string processName;
+    uint64_t processId;
+    size_t capacity;
+    // Sampled if the leading 64 bits of the object UUID are below this, so 0 samples nothing
+    std::atomic<uint64_t> sampleThreshold{0};
+    // Offset of the wall clock from the steady clock, so that the traces of different nodes line up
+    std::chrono::microseconds wallClockOffset;
+
+    mutable std::mutex mutex;
+    std::deque<nlohmann::json> events;
+    uint64_t droppedEvents{0};
+    std::unordered_set<std::string> namedLinks;
+};
+
+/**
+ * @brief Makes a trace context current on this thread for as long as it is in scope, so that code
+ * below the link, such as the S3 manager, can add spans to the operation without being passed
+ * the context. A null context leaves the operation untraced.
+ */
+class ActiveTraceContext {
+public:
+    explicit ActiveTraceContext(const TraceContext *context);
+    ~ActiveTraceContext();
+    ActiveTraceContext(const ActiveTraceContext &) = delete;
+    ActiveTraceContext &operator=(const ActiveTraceContext &) = delete;
+
+    /**
+     * @brief Get the context current on this thread, or null if the operation isn't traced.
+     */
+    static const TraceContext *get();
+
+private:
+    const TraceContext *previous;
+};
+
+/**
+ * @brief Adds a span covering its lifetime to the operation current on this thread, if that
+ * operation is traced.
+ */
+class TraceSpan {
+public:
+    TraceSpan(const char *name, const char *category);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const TraceContext *context;
+    const char *name;
+    const char *category;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif  // __SKYHOOK_TRANSPORT_TRACING_H__
@@ -24,6 +24,11 @@
 #include <exception>
 #include <string>
 
+#include "CancellationToken.h"
+
+// How often a cancellable transfer checks its token
+static const int CURL_CANCEL_POLL_MS = 20;
+
 class curl_exception : std::exception {
 public:
     explicit curl_exception(CURLcode code_) : code(code_) {}
@@ -76,6 +81,46 @@ public:
         }
     }
 
+    // Like perform(), but aborts the transfer shortly after the token is cancelled
+    void perform(const CancellationToken &cancelToken) {
+        CURLM *multi = curl_multi_init();
+        if (!multi) {
+            throw curl_exception(CURLE_FAILED_INIT);
+        }
+        curl_multi_add_handle(multi, curl);
+
+        CURLcode res = CURLE_OK;
+        int running = 1;
+        while (running) {
+            if (cancelToken.isCancelled()) {
+                res = CURLE_ABORTED_BY_CALLBACK;
+                break;
+            }
+            if (curl_multi_perform(multi, &running) != CURLM_OK) {
+                res = CURLE_RECV_ERROR;
+                break;
+            }
+            if (running) {
+                curl_multi_poll(multi, NULL, 0, CURL_CANCEL_POLL_MS, NULL);
+            }
+        }
+
+        if (res == CURLE_OK) {
+            int remaining = 0;
+            while (CURLMsg *msg = curl_multi_info_read(multi, &remaining)) {
+                if (msg->msg == CURLMSG_DONE) {
+                    res = msg->data.result;
+                }
+            }
+        }
+
+        curl_multi_remove_handle(multi, curl);
+        curl_multi_cleanup(multi);
+        if (res != CURLE_OK) {
+            throw curl_exception(res);
+        }
+    }
+
     void createUploadForm(std::string &filePath) {
         // Create the form
         form = curl_mime_init(curl);
@@ -14,23 +14,198 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-
 #include "log.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
 static const std::string pluginNameForLogging = "PluginSkyhook";
 
-void logDebug(const std::string &message) {
-    RaceLog::logDebug(pluginNameForLogging, message, "");
+// Number of messages the log ring can hold before new debug and info messages are dropped
+static const size_t LOG_RING_CAPACITY = 4096;
+
+static std::atomic<int> runtimeLogLevel{SKYHOOK_LOG_LEVEL_TRACE};
+
+void setLogLevel(int level) {
+    runtimeLogLevel = level;
+}
+
+bool isLogLevelEnabled(int level) {
+    return level >= runtimeLogLevel.load(std::memory_order_relaxed);
+}
+
+bool parseLogLevel(const std::string &name, int &level) {
+    static const std::pair<const char *, int> LEVELS[] = {
+        {"trace", SKYHOOK_LOG_LEVEL_TRACE},     {"debug", SKYHOOK_LOG_LEVEL_DEBUG},
+        {"info", SKYHOOK_LOG_LEVEL_INFO},       {"warning", SKYHOOK_LOG_LEVEL_WARNING},
+        {"error", SKYHOOK_LOG_LEVEL_ERROR},
+    };
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    for (auto &entry : LEVELS) {
+        if (lower == entry.first) {
+            level = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void writeToRaceLog(int level, const std::string &message) {
+    // Parenthesized so the logging macros don't expand
+    switch (level) {
+        case SKYHOOK_LOG_LEVEL_DEBUG:
+            (RaceLog::logDebug)(pluginNameForLogging, message, "");
+            break;
+        case SKYHOOK_LOG_LEVEL_WARNING:
+            (RaceLog::logWarning)(pluginNameForLogging, message, "");
+            break;
+        case SKYHOOK_LOG_LEVEL_ERROR:
+            (RaceLog::logError)(pluginNameForLogging, message, "");
+            break;
+        default:
+            // Trace messages have always been logged at info level
+            (RaceLog::logInfo)(pluginNameForLogging, message, "");
+            break;
+    }
+}
+
+/**
+ * @brief Fixed-size ring of pending log messages, drained into the RACE log by a background
+ * thread so that callers never wait on log I/O. When the ring is full new debug and info messages
+ * are dropped and counted, and the count is logged once there is room again. Warnings and errors
+ * are never dropped: they wait for room instead, and once the ring is stopped they are written
+ * straight away.
+ */
+class LogRing {
+public:
+    LogRing() : entries(LOG_RING_CAPACITY), thread(&LogRing::run, this) {}
+
+    ~LogRing() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        conditionVariable.notify_one();
+        roomAvailable.notify_all();
+        thread.join();
+    }
+
+    void push(int level, std::string message) {
+        bool important = level >= SKYHOOK_LOG_LEVEL_WARNING;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (important) {
+                roomAvailable.wait(lock, [this] { return stopped or size < entries.size(); });
+            }
+            if (stopped and important) {
+                lock.unlock();
+                writeToRaceLog(level, message);
+                return;
+            }
+            if (stopped or size == entries.size()) {
+                ++dropped;
+                return;
+            }
+            entries[(head + size) % entries.size()] = {level, std::move(message)};
+            ++size;
+        }
+        conditionVariable.notify_one();
+    }
+
+private:
+    struct Entry {
+        int level;
+        std::string message;
+    };
+
+    void run() {
+        std::vector<Entry> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            conditionVariable.wait(lock, [this] { return stopped or size > 0; });
+            if (size == 0) {
+                // Stopped and drained
+                break;
+            }
+
+            // Take everything queued so far and write it without holding the lock
+            batch.clear();
+            for (; size > 0; --size) {
+                batch.push_back(std::move(entries[head]));
+                head = (head + 1) % entries.size();
+            }
+            size_t droppedCount = dropped;
+            dropped = 0;
+            lock.unlock();
+            roomAvailable.notify_all();
+
+            for (auto &entry : batch) {
+                writeToRaceLog(entry.level, entry.message);
+            }
+            if (droppedCount > 0) {
+                writeToRaceLog(SKYHOOK_LOG_LEVEL_WARNING,
+                               "log ring full, dropped " + std::to_string(droppedCount) +
+                                   " messages");
+            }
+
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+    // Notified when the log thread takes messages out of the ring, for warnings and errors
+    // waiting for room
+    std::condition_variable roomAvailable;
+    std::vector<Entry> entries;
+    size_t head{0};
+    size_t size{0};
+    size_t dropped{0};
+    bool stopped{false};
+    std::thread thread;
+};
+
+void writeLog(int level, std::string message) {
+    static LogRing ring;
+    ring.push(level, std::move(message));
+}
+
+static std::string describePayload(const unsigned char *data, size_t size) {
+    // FNV-1a, enough to tell payloads apart in the logs
+    uint64_t digest = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        digest = (digest ^ data[i]) * 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(digest));
+    return std::to_string(size) + " bytes, digest " + hex;
 }
 
-void logInfo(const std::string &message) {
-    RaceLog::logInfo(pluginNameForLogging, message, "");
+std::string describePayload(const std::vector<uint8_t> &data) {
+    return describePayload(data.data(), data.size());
 }
 
-void logWarning(const std::string &message) {
-    RaceLog::logWarning(pluginNameForLogging, message, "");
+std::string describePayload(const std::string &data) {
+    return describePayload(reinterpret_cast<const unsigned char *>(data.data()), data.size());
 }
 
-void logError(const std::string &message) {
-    RaceLog::logError(pluginNameForLogging, message, "");
+std::string traceMethodName(const char *prettyFunction) {
+    // e.g. "virtual ComponentStatus Link::fetch(std::vector<long unsigned int>, Timestamp)"
+    const char *end = std::strchr(prettyFunction, '(');
+    if (end == nullptr) {
+        return prettyFunction;
+    }
+    const char *begin = end;
+    while (begin > prettyFunction and *(begin - 1) != ' ') {
+        --begin;
+    }
+    return std::string(begin, end);
 }
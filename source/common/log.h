@@ -14,20 +14,111 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-
 #ifndef __COMMS_TWOSIX_COMMON_LOG_H__
 #define __COMMS_TWOSIX_COMMON_LOG_H__
 
 #include <RaceLog.h>
 
+#include <cstdint>
 #include <string>
+#include <vector>
+
+// Log levels, from most to least verbose. TRACE is the entry and exit logging of TRACE_METHOD and
+// TRACE_FUNCTION.
+#define SKYHOOK_LOG_LEVEL_TRACE 0
+#define SKYHOOK_LOG_LEVEL_DEBUG 1
+#define SKYHOOK_LOG_LEVEL_INFO 2
+#define SKYHOOK_LOG_LEVEL_WARNING 3
+#define SKYHOOK_LOG_LEVEL_ERROR 4
+
+// Messages below this level are compiled out entirely. Set by the SKYHOOK_LOG_LEVEL CMake option.
+#ifndef SKYHOOK_MIN_LOG_LEVEL
+#define SKYHOOK_MIN_LOG_LEVEL SKYHOOK_LOG_LEVEL_INFO
+#endif
+
+/**
+ * @brief Set the minimum level of messages that are logged at runtime, e.g. from the logLevel
+ * user input. Messages below the compile-time minimum level are never logged.
+ *
+ * @param level One of the SKYHOOK_LOG_LEVEL_* values
+ */
+void setLogLevel(int level);
+bool isLogLevelEnabled(int level);
+
+/**
+ * @brief Parse a log level name: trace, debug, info, warning, or error, in any case.
+ *
+ * @param name Name of the level
+ * @param level Set to the SKYHOOK_LOG_LEVEL_* value of the level
+ * @return true if the name was valid
+ */
+bool parseLogLevel(const std::string &name, int &level);
+
+/**
+ * @brief Queue a message to be written to the RACE log by the background log thread. Debug and
+ * info messages are dropped if the queue is full, while warnings and errors wait for room. Use the
+ * logDebug, logInfo, logWarning, and logError macros instead, which skip building the message
+ * when its level is disabled.
+ *
+ * @param level One of the SKYHOOK_LOG_LEVEL_* values
+ * @param message Message to log
+ */
+void writeLog(int level, std::string message);
 
-void logDebug(const std::string &message);
-void logInfo(const std::string &message);
-void logWarning(const std::string &message);
-void logError(const std::string &message);
+/**
+ * @brief Describe a payload by its size and digest, for logging in place of the payload itself.
+ *
+ * @param data Payload
+ * @return Description of the payload
+ */
+std::string describePayload(const std::vector<uint8_t> &data);
+std::string describePayload(const std::string &data);
+
+// The message expression is only evaluated if the level is enabled
+#define SKYHOOK_LOG(level, ...)                                                  \
+    do {                                                                         \
+        if ((level) >= SKYHOOK_MIN_LOG_LEVEL and isLogLevelEnabled(level)) {     \
+            writeLog((level), __VA_ARGS__);                                      \
+        }                                                                        \
+    } while (0)
+
+#define logDebug(...) SKYHOOK_LOG(SKYHOOK_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define logInfo(...) SKYHOOK_LOG(SKYHOOK_LOG_LEVEL_INFO, __VA_ARGS__)
+#define logWarning(...) SKYHOOK_LOG(SKYHOOK_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define logError(...) SKYHOOK_LOG(SKYHOOK_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+/**
+ * @brief Get the qualified name of a method from its __PRETTY_FUNCTION__, e.g. "Link::fetch".
+ */
+std::string traceMethodName(const char *prettyFunction);
+
+/**
+ * @brief Logs the return of a traced method or function when it goes out of scope, if tracing is
+ * enabled.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const std::string &logPrefix) :
+        logPrefix(logPrefix),
+        enabled(SKYHOOK_LOG_LEVEL_TRACE >= SKYHOOK_MIN_LOG_LEVEL and
+                isLogLevelEnabled(SKYHOOK_LOG_LEVEL_TRACE)) {}
+    ~TraceScope() {
+        if (enabled) {
+            writeLog(SKYHOOK_LOG_LEVEL_TRACE, logPrefix + "returned");
+        }
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+private:
+    const std::string &logPrefix;
+    bool enabled;
+};
 
-// logDebug messages don't make it to stdout
 #ifdef TRACE_METHOD_BASE
 #undef TRACE_METHOD_BASE
 #endif
@@ -36,19 +127,24 @@ void logError(const std::string &message);
 #undef TRACE_FUNCTION_BASE
 #endif
 
-#define TRACE_METHOD_BASE(pluginName, ...)                                                         \
-    std::string logPrefix = RaceLog::cppDemangle(typeid(*this).name()) + "::" + __func__ + ": ";   \
-    RaceLog::logInfo(                                                                             \
-        #pluginName, logPrefix + "called" + RaceLog::stringifyValues(#__VA_ARGS__, ##__VA_ARGS__), \
-        "");                                                                                       \
-    Defer defer([logPrefix] { RaceLog::logInfo(#pluginName, logPrefix + "returned", ""); })
-
-#define TRACE_FUNCTION_BASE(pluginName, ...)                                                       \
-    std::string logPrefix = std::string(__func__) + ": ";                                          \
-    RaceLog::logInfo(#pluginName,                                                                  \
-                     logPrefix + "called" + RaceLog::stringifyValues(#__VA_ARGS__, ##__VA_ARGS__), \
-                     "");                                                                          \
-    Defer defer([logPrefix] { RaceLog::logInfo(#pluginName, logPrefix + "returned", ""); })
+// The method name is worked out once per call site, and the arguments are only stringified when
+// tracing is enabled. Both define the logPrefix used by the rest of the method.
+#define TRACE_METHOD_BASE(pluginName, ...)                                                        \
+    static const std::string traceName = traceMethodName(__PRETTY_FUNCTION__) + ": ";             \
+    std::string logPrefix = traceName;                                                            \
+    TraceScope traceScope(logPrefix);                                                             \
+    if (traceScope.isEnabled()) {                                                                 \
+        writeLog(SKYHOOK_LOG_LEVEL_TRACE,                                                         \
+                 logPrefix + "called" + RaceLog::stringifyValues(#__VA_ARGS__, ##__VA_ARGS__));   \
+    }
+
+#define TRACE_FUNCTION_BASE(pluginName, ...)                                                      \
+    std::string logPrefix = std::string(__func__) + ": ";                                         \
+    TraceScope traceScope(logPrefix);                                                             \
+    if (traceScope.isEnabled()) {                                                                 \
+        writeLog(SKYHOOK_LOG_LEVEL_TRACE,                                                         \
+                 logPrefix + "called" + RaceLog::stringifyValues(#__VA_ARGS__, ##__VA_ARGS__));   \
+    }
 
 #define TRACE_METHOD(...) TRACE_METHOD_BASE(PluginSkyhook, ##__VA_ARGS__)
 #define TRACE_FUNCTION(...) TRACE_FUNCTION_BASE(PluginSkyhook, ##__VA_ARGS__)
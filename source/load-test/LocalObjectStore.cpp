@@ -0,0 +1,485 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "LocalObjectStore.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+#include "log.h"
+
+static const size_t READ_SIZE = 64 * 1024;
+
+/**
+ * @brief Buffered reads of lines and fixed-size blocks, either from a socket or from a string
+ * that was already read in full
+ */
+class BufferedReader {
+public:
+    explicit BufferedReader(int fd) : fd(fd) {}
+    explicit BufferedReader(std::string data) : fd(-1), buffer(std::move(data)) {}
+
+    /**
+     * @brief Read up to the next CRLF, which is dropped
+     */
+    bool readLine(std::string &line) {
+        size_t end;
+        while ((end = buffer.find("\r\n", offset)) == std::string::npos) {
+            if (not fill()) {
+                return false;
+            }
+        }
+        line = buffer.substr(offset, end - offset);
+        offset = end + 2;
+        return true;
+    }
+
+    bool read(size_t size, std::string &data) {
+        while (buffer.size() - offset < size) {
+            if (not fill()) {
+                return false;
+            }
+        }
+        data.append(buffer, offset, size);
+        offset += size;
+        return true;
+    }
+
+private:
+    bool fill() {
+        if (fd < 0) {
+            return false;
+        }
+        buffer.erase(0, offset);
+        offset = 0;
+        char chunk[READ_SIZE];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+        return true;
+    }
+
+    int fd;
+    std::string buffer;
+    size_t offset{0};
+};
+
+/**
+ * @brief Read a body in chunked encoding, as used by HTTP chunked transfer encoding and by the
+ * aws-chunked content encoding of the AWS SDK. Chunk extensions and trailers are ignored.
+ */
+static bool readChunked(BufferedReader &reader, std::string &body) {
+    std::string line;
+    while (reader.readLine(line)) {
+        size_t size;
+        try {
+            size = std::stoul(line.substr(0, line.find(';')), nullptr, 16);
+        } catch (std::exception &) {
+            return false;
+        }
+        if (size == 0) {
+            while (reader.readLine(line) and not line.empty()) {
+            }
+            return true;
+        }
+        if (not reader.read(size, body) or not reader.readLine(line)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (result <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+static std::string toLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+static const char *statusText(int status) {
+    switch (status) {
+        case 100:
+            return "Continue";
+        case 200:
+            return "OK";
+        case 204:
+            return "No Content";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 409:
+            return "Conflict";
+        default:
+            return "Unknown";
+    }
+}
+
+LocalObjectStore::LocalObjectStore(MetricsRegistry &metrics, const Options &options) :
+    options(options),
+    requests(metrics.counter("store_request_count")),
+    droppedRequests(metrics.counter("store_dropped_request_count")),
+    gets(metrics.counter("store_get_count")),
+    getMisses(metrics.counter("store_get_miss_count")),
+    puts(metrics.counter("store_put_count")),
+    deletes(metrics.counter("store_delete_count")),
+    policyWrites(metrics.counter("store_policy_write_count")),
+    bucketWrites(metrics.counter("store_bucket_write_count")),
+    errors(metrics.counter("store_error_count")),
+    bytesIn(metrics.counter("store_bytes_in")),
+    bytesOut(metrics.counter("store_bytes_out")) {}
+
+LocalObjectStore::~LocalObjectStore() {
+    stop();
+}
+
+void LocalObjectStore::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    }
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    socklen_t addressLength = sizeof(address);
+    if (bind(listenFd, reinterpret_cast<sockaddr *>(&address), addressLength) < 0 or
+        listen(listenFd, SOMAXCONN) < 0 or
+        getsockname(listenFd, reinterpret_cast<sockaddr *>(&address), &addressLength) < 0) {
+        std::string error = std::strerror(errno);
+        close(listenFd);
+        listenFd = -1;
+        throw std::runtime_error("failed to listen on port " + std::to_string(options.port) +
+                                 ": " + error);
+    }
+    port = ntohs(address.sin_port);
+    running = true;
+    acceptThread = std::thread(&LocalObjectStore::acceptConnections, this);
+    logInfo("LocalObjectStore: listening on " + getEndpoint());
+}
+
+void LocalObjectStore::stop() {
+    if (not running.exchange(false)) {
+        return;
+    }
+    // Wakes up the blocked accept
+    shutdown(listenFd, SHUT_RDWR);
+    acceptThread.join();
+    close(listenFd);
+    listenFd = -1;
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (auto &connection : connections) {
+        shutdown(connection.fd, SHUT_RDWR);
+    }
+    for (auto &connection : connections) {
+        connection.thread.join();
+        close(connection.fd);
+    }
+    connections.clear();
+}
+
+std::string LocalObjectStore::getEndpoint() const {
+    return "http://127.0.0.1:" + std::to_string(port);
+}
+
+size_t LocalObjectStore::getObjectCount() const {
+    std::lock_guard<std::mutex> lock(bucketsMutex);
+    return objectCount;
+}
+
+std::string LocalObjectStore::getBucketPolicy(const std::string &bucket) const {
+    std::lock_guard<std::mutex> lock(bucketsMutex);
+    auto iter = buckets.find(bucket);
+    return iter == buckets.end() ? "" : iter->second.policy;
+}
+
+void LocalObjectStore::acceptConnections() {
+    while (running) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR or errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        if (not running) {
+            close(fd);
+            break;
+        }
+        // Reap the connections that have been closed since the last one was accepted
+        for (auto iter = connections.begin(); iter != connections.end();) {
+            if (iter->done) {
+                iter->thread.join();
+                close(iter->fd);
+                iter = connections.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        connections.emplace_back();
+        Connection *connection = &connections.back();
+        connection->fd = fd;
+        connection->thread = std::thread(&LocalObjectStore::serveConnection, this, connection);
+    }
+}
+
+void LocalObjectStore::serveConnection(Connection *connection) {
+    BufferedReader reader(connection->fd);
+    bool keepAlive = true;
+    while (keepAlive) {
+        Request request;
+        std::string line;
+        if (not reader.readLine(line)) {
+            break;
+        }
+        std::string target;
+        size_t methodEnd = line.find(' ');
+        size_t targetEnd = line.find(' ', methodEnd + 1);
+        if (methodEnd == std::string::npos or targetEnd == std::string::npos) {
+            break;
+        }
+        request.method = line.substr(0, methodEnd);
+        target = line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+
+        while (reader.readLine(line) and not line.empty()) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            size_t valueStart = line.find_first_not_of(' ', colon + 1);
+            request.headers[toLower(line.substr(0, colon))] =
+                valueStart == std::string::npos ? "" : line.substr(valueStart);
+        }
+
+        auto header = [&request](const std::string &name) {
+            auto iter = request.headers.find(name);
+            return iter == request.headers.end() ? std::string() : toLower(iter->second);
+        };
+        keepAlive = header("connection") != "close";
+        if (header("expect") == "100-continue" and
+            not sendAll(connection->fd, "HTTP/1.1 100 Continue\r\n\r\n")) {
+            break;
+        }
+
+        bool bodyRead = true;
+        if (header("transfer-encoding").find("chunked") != std::string::npos) {
+            bodyRead = readChunked(reader, request.body);
+        } else if (not header("content-length").empty()) {
+            try {
+                bodyRead = reader.read(std::stoul(header("content-length")), request.body);
+            } catch (std::exception &) {
+                bodyRead = false;
+            }
+        }
+        if (not bodyRead) {
+            break;
+        }
+        if (header("content-encoding").find("aws-chunked") != std::string::npos) {
+            // The SDK streams the body in signed chunks followed by checksum trailers
+            BufferedReader bodyReader(std::move(request.body));
+            request.body.clear();
+            readChunked(bodyReader, request.body);
+        }
+        requests.add();
+        bytesIn.add(request.body.size());
+
+        size_t queryStart = target.find('?');
+        if (queryStart != std::string::npos) {
+            request.query = target.substr(queryStart + 1);
+            target.erase(queryStart);
+        }
+        // Path-style addressing: /bucket or /bucket/key
+        size_t keyStart = target.find('/', 1);
+        request.bucket = target.substr(1, keyStart == std::string::npos ? std::string::npos :
+                                                                          keyStart - 1);
+        if (keyStart != std::string::npos) {
+            request.key = target.substr(keyStart + 1);
+        }
+
+        std::chrono::milliseconds delay = responseDelay();
+        if (dropRequest()) {
+            // Lost on the way to the store, so it has no effect
+            droppedRequests.add();
+            std::this_thread::sleep_for(delay);
+            break;
+        }
+        Response response = handleRequest(request);
+        std::this_thread::sleep_for(delay);
+
+        if (response.status >= 400) {
+            errors.add();
+        }
+        bool head = request.method == "HEAD";
+        std::string message = "HTTP/1.1 " + std::to_string(response.status) + " " +
+                              statusText(response.status) + "\r\n";
+        response.headers["Content-Length"] = std::to_string(response.body.size());
+        if (not keepAlive) {
+            response.headers["Connection"] = "close";
+        }
+        for (auto &entry : response.headers) {
+            message += entry.first + ": " + entry.second + "\r\n";
+        }
+        message += "\r\n";
+        if (not head) {
+            message += response.body;
+            bytesOut.add(response.body.size());
+        }
+        if (not sendAll(connection->fd, message)) {
+            break;
+        }
+    }
+    shutdown(connection->fd, SHUT_RDWR);
+    connection->done = true;
+}
+
+LocalObjectStore::Response LocalObjectStore::handleRequest(const Request &request) {
+    if (request.bucket.empty()) {
+        return errorResponse(400, "InvalidBucketName", "No bucket given");
+    }
+    if (request.key.empty()) {
+        return handleBucketRequest(request);
+    }
+    return handleObjectRequest(request);
+}
+
+LocalObjectStore::Response LocalObjectStore::handleBucketRequest(const Request &request) {
+    std::lock_guard<std::mutex> lock(bucketsMutex);
+    auto iter = buckets.find(request.bucket);
+
+    if (request.method == "PUT" and request.query.empty()) {
+        // Creating a bucket that already exists is allowed, like in us-east-1
+        bucketWrites.add();
+        buckets[request.bucket];
+        return {200, "", {{"Location", "/" + request.bucket}}};
+    }
+    if (iter == buckets.end()) {
+        return errorResponse(404, "NoSuchBucket", "The specified bucket does not exist");
+    }
+
+    if (request.method == "PUT" and request.query.rfind("policy", 0) == 0) {
+        policyWrites.add();
+        iter->second.policy = request.body;
+        return {204, "", {}};
+    }
+    if (request.method == "GET" and request.query.rfind("policy", 0) == 0) {
+        if (iter->second.policy.empty()) {
+            return errorResponse(404, "NoSuchBucketPolicy", "The bucket policy does not exist");
+        }
+        return {200, iter->second.policy, {{"Content-Type", "application/json"}}};
+    }
+    if (request.method == "PUT" and request.query.rfind("publicAccessBlock", 0) == 0) {
+        bucketWrites.add();
+        return {200, "", {}};
+    }
+    if (request.method == "DELETE" and request.query.empty()) {
+        if (not iter->second.objects.empty()) {
+            return errorResponse(409, "BucketNotEmpty",
+                                 "The bucket you tried to delete is not empty");
+        }
+        bucketWrites.add();
+        buckets.erase(iter);
+        return {204, "", {}};
+    }
+    return errorResponse(405, "MethodNotAllowed", "Unsupported bucket request");
+}
+
+LocalObjectStore::Response LocalObjectStore::handleObjectRequest(const Request &request) {
+    std::lock_guard<std::mutex> lock(bucketsMutex);
+    auto iter = buckets.find(request.bucket);
+    if (iter == buckets.end()) {
+        return errorResponse(404, "NoSuchBucket", "The specified bucket does not exist");
+    }
+    auto &objects = iter->second.objects;
+
+    if (request.method == "GET" or request.method == "HEAD") {
+        gets.add();
+        auto object = objects.find(request.key);
+        if (object == objects.end()) {
+            getMisses.add();
+            return errorResponse(404, "NoSuchKey", "The specified key does not exist.");
+        }
+        return {200, object->second, {{"Content-Type", "application/octet-stream"}}};
+    }
+    if (request.method == "PUT") {
+        puts.add();
+        auto result = objects.insert_or_assign(request.key, request.body);
+        objectCount += result.second ? 1 : 0;
+        return {200, "", {{"ETag", "\"" + std::to_string(request.body.size()) + "\""}}};
+    }
+    if (request.method == "DELETE") {
+        deletes.add();
+        objectCount -= objects.erase(request.key);
+        return {204, "", {}};
+    }
+    return errorResponse(405, "MethodNotAllowed", "Unsupported object request");
+}
+
+LocalObjectStore::Response LocalObjectStore::errorResponse(int status, const std::string &code,
+                                                           const std::string &message) {
+    return {status,
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Error><Code>" + code +
+                "</Code><Message>" + message + "</Message></Error>",
+            {{"Content-Type", "application/xml"}}};
+}
+
+std::chrono::milliseconds LocalObjectStore::responseDelay() {
+    if (options.latencyJitter.count() <= 0) {
+        return options.latency;
+    }
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    std::uniform_int_distribution<int64_t> distribution(-options.latencyJitter.count(),
+                                                        options.latencyJitter.count());
+    return std::max(std::chrono::milliseconds(0),
+                    options.latency + std::chrono::milliseconds(distribution(generator)));
+}
+
+bool LocalObjectStore::dropRequest() {
+    if (options.loss <= 0) {
+        return false;
+    }
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    std::uniform_real_distribution<double> distribution(0, 1);
+    return distribution(generator) < options.loss;
+}
@@ -0,0 +1,148 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef __SKYHOOK_LOAD_TEST_LOCAL_OBJECT_STORE_H__
+#define __SKYHOOK_LOAD_TEST_LOCAL_OBJECT_STORE_H__
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "Metrics.h"
+
+/**
+ * @brief In-memory stand-in for S3, served over plain HTTP on the loopback interface. It handles
+ * the path-style requests the transports make: bucket create/delete, bucket policy and public
+ * access block writes, and object get/put/delete. Policies are stored but not enforced, and
+ * requests are not authenticated.
+ *
+ * Every response can be delayed to emulate the round trip to S3, and requests can be dropped
+ * without a response to emulate loss. This class is thread-safe.
+ */
+class LocalObjectStore {
+public:
+    struct Options {
+        // Port to listen on, or 0 for any free port
+        int port{0};
+        // Delay added to every response, plus a uniformly distributed jitter of up to
+        // latencyJitter either way
+        std::chrono::milliseconds latency{0};
+        std::chrono::milliseconds latencyJitter{0};
+        // Fraction of requests dropped by closing the connection without a response
+        double loss{0};
+    };
+
+    LocalObjectStore(MetricsRegistry &metrics, const Options &options);
+    ~LocalObjectStore();
+
+    /**
+     * @brief Start listening for connections.
+     *
+     * @throws std::runtime_error if the socket can't be bound
+     */
+    void start();
+
+    /**
+     * @brief Stop listening and close all connections.
+     */
+    void stop();
+
+    /**
+     * @brief Get the endpoint to point the transports at, e.g. "http://127.0.0.1:9000".
+     */
+    std::string getEndpoint() const;
+
+    /**
+     * @brief Get the number of objects currently stored across all buckets.
+     */
+    size_t getObjectCount() const;
+
+    /**
+     * @brief Get the policy last written to a bucket.
+     *
+     * @param bucket Name of the bucket
+     * @return The policy JSON, or an empty string if the bucket or its policy doesn't exist
+     */
+    std::string getBucketPolicy(const std::string &bucket) const;
+
+private:
+    struct Request {
+        std::string method;
+        std::string bucket;
+        std::string key;
+        std::string query;
+        std::unordered_map<std::string, std::string> headers;
+        std::string body;
+    };
+
+    struct Response {
+        int status;
+        std::string body;
+        std::map<std::string, std::string> headers;
+    };
+
+    struct Bucket {
+        std::string policy;
+        std::unordered_map<std::string, std::string> objects;
+    };
+
+    struct Connection {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    void acceptConnections();
+    void serveConnection(Connection *connection);
+    Response handleRequest(const Request &request);
+    Response handleBucketRequest(const Request &request);
+    Response handleObjectRequest(const Request &request);
+    static Response errorResponse(int status, const std::string &code, const std::string &message);
+    std::chrono::milliseconds responseDelay();
+    bool dropRequest();
+
+    Options options;
+    int listenFd{-1};
+    int port{0};
+    std::atomic<bool> running{false};
+    std::thread acceptThread;
+
+    std::mutex connectionsMutex;
+    std::list<Connection> connections;
+
+    mutable std::mutex bucketsMutex;
+    std::unordered_map<std::string, Bucket> buckets;
+    size_t objectCount{0};
+
+    Counter &requests;
+    Counter &droppedRequests;
+    Counter &gets;
+    Counter &getMisses;
+    Counter &puts;
+    Counter &deletes;
+    Counter &policyWrites;
+    Counter &bucketWrites;
+    Counter &errors;
+    Counter &bytesIn;
+    Counter &bytesOut;
+};
+
+#endif  // __SKYHOOK_LOAD_TEST_LOCAL_OBJECT_STORE_H__
@@ -0,0 +1,990 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// End-to-end load test of the transport. A public user and an account holder, each with its
+// transport and user model, are wired to mock SDKs and exchange messages over N links through a
+// local stand-in for S3, so the whole exchange runs on one machine without an AWS account. The
+// mock SDKs take the place of the RACE framework: they answer user input, and execute the user
+// models' timelines against the transports.
+
+#include <aws/core/Aws.h>
+#include <signal.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "JsonTypes.h"
+#include "LinkAddress.h"
+#include "LinkUserModel.h"
+#include "LocalObjectStore.h"
+#include "Metrics.h"
+#include "MockTransportSdk.h"
+#include "MockUserModelSdk.h"
+#include "RequestBudget.h"
+#include "SkyhookBaseUserModel.h"
+#include "SkyhookTransportAccountHolder.h"
+#include "SkyhookTransportPublicUser.h"
+#include "log.h"
+
+struct LoadTestConfig {
+    int links{10};
+    // Size of each message, including the header used to measure its delivery
+    size_t messageSize{1024};
+    // Mean messages per second on each link in each direction, sent as a Poisson process
+    double rate{0.2};
+    // Upstream is from the public user to the account holder
+    bool upstream{true};
+    bool downstream{true};
+    // Seconds to send messages for, and the most to wait afterwards for them to be delivered
+    double duration{60};
+    double drain{30};
+    // Seconds into the run to tear down both ends and restore their links, or 0 not to
+    double restartAt{0};
+    // LinkParameters JSON given to the user models, e.g. {"polling_interval_ms": 500}
+    std::string linkParams{"{}"};
+    // Request budget of each user model, e.g. 10/s, or empty for unlimited
+    std::string requestBudget;
+    LocalObjectStore::Options store;
+    // File to write the JSON report to, if any
+    std::string reportFile;
+    // File to write the merged trace of both ends to, if any, and the fraction of packages traced
+    std::string traceFile;
+    double traceSampleRate{1.0};
+    int logLevel{SKYHOOK_LOG_LEVEL_ERROR};
+};
+
+// Every message starts with its size, send time, sequence number, and the index of the link it was
+// sent on, so that the receiver can split up posts holding several messages, measure the delivery
+// latency of each, and check it arrived on the right link
+static const size_t MESSAGE_HEADER_SIZE = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+static const std::chrono::seconds PROGRESS_PERIOD(10);
+
+// Interval the user model's fetch bursts start at
+static const double BURST_INITIAL_INTERVAL = 0.1;
+
+/**
+ * @brief Get the current time as a timeline timestamp
+ */
+static Timestamp currentTimestamp() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+static uint64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief Delivery statistics of the messages in both directions. This class is thread-safe.
+ */
+class LoadStats {
+public:
+    explicit LoadStats(MetricsRegistry &metrics) :
+        generated(metrics.counter("load_generated_count")),
+        posted(metrics.counter("load_posted_count")),
+        postFailed(metrics.counter("load_post_failed_count")),
+        delivered(metrics.counter("load_delivered_count")),
+        duplicates(metrics.counter("load_duplicate_count")),
+        malformed(metrics.counter("load_malformed_count")),
+        misrouted(metrics.counter("load_misrouted_count")),
+        deliveredBytes(metrics.counter("load_delivered_bytes")),
+        latency(metrics.histogram("load_delivery_latency_us")) {}
+
+    /**
+     * @brief Register a link before any messages are sent on it.
+     */
+    void addLink(const LinkID &linkId) {
+        linkIndexes.emplace(linkId, static_cast<uint32_t>(linkIndexes.size()));
+    }
+
+    std::vector<uint8_t> makeMessage(const LinkID &linkId, size_t size) {
+        size = std::max(size, MESSAGE_HEADER_SIZE);
+        std::vector<uint8_t> message(size);
+        uint32_t messageSize = static_cast<uint32_t>(size);
+        uint64_t sendTime = steadyNanoseconds();
+        uint64_t sequence = nextSequence++;
+        uint32_t linkIndex = linkIndexes.at(linkId);
+        uint8_t *header = message.data();
+        std::memcpy(header, &messageSize, sizeof(messageSize));
+        std::memcpy(header + sizeof(messageSize), &sendTime, sizeof(sendTime));
+        std::memcpy(header + sizeof(messageSize) + sizeof(sendTime), &sequence, sizeof(sequence));
+        std::memcpy(header + sizeof(messageSize) + sizeof(sendTime) + sizeof(sequence), &linkIndex,
+                    sizeof(linkIndex));
+        generated.add();
+        return message;
+    }
+
+    void onReceive(const LinkID &linkId, const std::vector<uint8_t> &content) {
+        uint64_t now = steadyNanoseconds();
+        auto expectedIndex = linkIndexes.find(linkId);
+        size_t offset = 0;
+        while (content.size() - offset >= MESSAGE_HEADER_SIZE) {
+            uint32_t messageSize;
+            uint64_t sendTime;
+            uint64_t sequence;
+            uint32_t linkIndex;
+            const uint8_t *header = content.data() + offset;
+            std::memcpy(&messageSize, header, sizeof(messageSize));
+            std::memcpy(&sendTime, header + sizeof(messageSize), sizeof(sendTime));
+            std::memcpy(&sequence, header + sizeof(messageSize) + sizeof(sendTime),
+                        sizeof(sequence));
+            std::memcpy(&linkIndex,
+                        header + sizeof(messageSize) + sizeof(sendTime) + sizeof(sequence),
+                        sizeof(linkIndex));
+            if (messageSize < MESSAGE_HEADER_SIZE or messageSize > content.size() - offset) {
+                break;
+            }
+            offset += messageSize;
+
+            // Links must not see each other's objects
+            if (expectedIndex == linkIndexes.end() or linkIndex != expectedIndex->second) {
+                misrouted.add();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (not seen.insert(sequence).second) {
+                    duplicates.add();
+                    continue;
+                }
+            }
+            delivered.add();
+            deliveredBytes.add(messageSize);
+            latency.record((now - sendTime) / 1000);
+        }
+        if (offset != content.size()) {
+            malformed.add();
+        }
+    }
+
+    void onPackageStatusChanged(PackageStatus status) {
+        if (status == PACKAGE_SENT) {
+            posted.add();
+        } else {
+            postFailed.add();
+        }
+    }
+
+    RaceHandle nextHandle() {
+        return ++lastHandle;
+    }
+
+    Counter &generated;
+    Counter &posted;
+    Counter &postFailed;
+    Counter &delivered;
+    Counter &duplicates;
+    Counter &malformed;
+    Counter &misrouted;
+    Counter &deliveredBytes;
+    Histogram &latency;
+
+private:
+    std::atomic<uint64_t> nextSequence{0};
+    std::atomic<RaceHandle> lastHandle{0};
+    // Index of every link, only written before messages are sent
+    std::unordered_map<LinkID, uint32_t> linkIndexes;
+    std::mutex mutex;
+    std::unordered_set<uint64_t> seen;
+};
+
+/**
+ * @brief Answer the user input requests of a component from the responses preset on its SDK
+ */
+template <typename Sdk, typename Component>
+static void answerUserInput(Sdk &sdk, Component &component) {
+    for (auto &request : sdk.getUserInputRequests()) {
+        std::string response;
+        bool answered = sdk.getUserInputResponse(request.second, response);
+        component.onUserInputReceived(request.first, answered, response);
+    }
+}
+
+/**
+ * @brief One end of the links: a transport and user model, with the mock SDKs standing in for the
+ * RACE framework. Messages sent on a link are handed to the user model, and the resulting post
+ * actions and the fetch actions of the user model's timeline are executed against the transport
+ * on an action thread when they are due.
+ */
+class Node {
+public:
+    Node(const std::string &name, bool accountHolder, const LoadTestConfig &config,
+         LoadStats &stats) :
+        name(name),
+        accountHolder(accountHolder),
+        linkParams(config.linkParams),
+        stats(stats),
+        transportSdk(channelProperties(config), name),
+        userModelSdk(channelProperties(config), name) {
+        transportSdk.setUserInputResponse("region", "us-east-1");
+        transportSdk.setUserInputResponse("bucket", "skyhook-load-test");
+        transportSdk.setUserInputResponse("seed", "skyhook-load-test");
+        transportSdk.setUserInputResponse("singleReceive", "false");
+        transportSdk.setUserInputResponse("canonicalId", "skyhook-load-test");
+        if (not config.requestBudget.empty()) {
+            userModelSdk.setUserInputResponse("requestBudget", config.requestBudget);
+        }
+        if (not config.traceFile.empty()) {
+            transportSdk.setUserInputResponse("traceSampleRate",
+                                              std::to_string(config.traceSampleRate));
+        }
+
+        userModelSdk.timelineUpdatedHandler = [this]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            timelineUpdated = true;
+            conditionVariable.notify_one();
+        };
+        transportSdk.linkStatusHandler = [this](RaceHandle, const LinkID &linkId,
+                                                LinkStatus status, const LinkParameters &params) {
+            // Like the framework, hand the user model the link with the transport's parameters,
+            // on top of the configured hints
+            if (status == LINK_CREATED or status == LINK_LOADED) {
+                nlohmann::json hints = nlohmann::json::parse(linkParams);
+                if (not params.json.empty()) {
+                    hints.update(nlohmann::json::parse(params.json));
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    fetchRequests[linkId] = hints.value("fetch_requests", 1);
+                }
+                userModel->addLink(linkId, {hints.dump()});
+            }
+        };
+        transportSdk.eventHandler = [this](const Event &event) {
+            EventJson eventJson = nlohmann::json::parse(event.json);
+            if (eventJson.type == EVENT_DRAIN) {
+                std::lock_guard<std::mutex> lock(mutex);
+                scheduledRequests += eventJson.requests;
+                largestDrainRequests = std::max(largestDrainRequests, eventJson.requests);
+            }
+            userModel->onTransportEvent(event);
+        };
+        transportSdk.packageStatusHandler = [this](RaceHandle, PackageStatus status) {
+            this->stats.onPackageStatusChanged(status);
+        };
+        transportSdk.receiveHandler = [this](const LinkID &linkId, const EncodingParameters &,
+                                             const std::vector<uint8_t> &content) {
+            this->stats.onReceive(linkId, content);
+        };
+
+        startComponents();
+    }
+
+    ~Node() {
+        stop();
+    }
+
+    /**
+     * @brief Create a link, as the account holder does.
+     *
+     * @return The address of the link, for the other end to load
+     */
+    std::string createLink(const LinkID &linkId) {
+        if (transport->createLink(stats.nextHandle(), linkId) != COMPONENT_OK) {
+            throw std::runtime_error(name + ": failed to create link " + linkId);
+        }
+        std::string linkAddress = transport->getLinkProperties(linkId).linkAddress;
+        linkAddresses.emplace_back(linkId, linkAddress);
+        return linkAddress;
+    }
+
+    /**
+     * @brief Load a link from its address, as the public user does.
+     */
+    void loadLink(const LinkID &linkId, const std::string &linkAddress) {
+        if (transport->loadLinkAddress(stats.nextHandle(), linkId, linkAddress) != COMPONENT_OK) {
+            throw std::runtime_error(name + ": failed to load link " + linkId);
+        }
+        linkAddresses.emplace_back(linkId, linkAddress);
+    }
+
+    /**
+     * @brief Tear down the transport and user model, as when the node restarts, and bring them
+     * back up on the same storage. The links are restored from their addresses, as the framework
+     * does, and carry on from their checkpoints.
+     */
+    void restart() {
+        stop();
+        transport.reset();
+        userModel.reset();
+        {
+            // Messages still waiting for their post action are lost with the user model
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto &entry : postMessages) {
+                for (size_t idx = 0; idx < entry.second.size(); ++idx) {
+                    stats.onPackageStatusChanged(PACKAGE_FAILED_GENERIC);
+                }
+            }
+            schedule.clear();
+            knownFetches.clear();
+            scheduledPosts.clear();
+            postMessages.clear();
+        }
+
+        transportSdk.clearUserInputRequests();
+        userModelSdk.clearUserInputRequests();
+        startComponents();
+        for (auto &entry : linkAddresses) {
+            ComponentStatus status =
+                accountHolder ?
+                    transport->createLinkFromAddress(stats.nextHandle(), entry.first, entry.second) :
+                    transport->loadLinkAddress(stats.nextHandle(), entry.first, entry.second);
+            if (status != COMPONENT_OK) {
+                throw std::runtime_error(name + ": failed to restore link " + entry.first);
+            }
+        }
+        start();
+    }
+
+    void start() {
+        running = true;
+        actionThread = std::thread(&Node::runActions, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        conditionVariable.notify_one();
+        if (actionThread.joinable()) {
+            actionThread.join();
+        }
+    }
+
+    /**
+     * @brief Send a message on a link. It is posted by the post action the user model gives it.
+     */
+    void send(const LinkID &linkId, std::vector<uint8_t> message) {
+        ActionTimeline actions = userModel->onSendPackage(linkId, static_cast<int>(message.size()));
+        if (actions.empty()) {
+            stats.onPackageStatusChanged(PACKAGE_FAILED_GENERIC);
+            return;
+        }
+        const Action &action = actions.front();
+        std::lock_guard<std::mutex> lock(mutex);
+        // Messages given the same action while it is held for aggregation are posted together
+        postMessages[action.actionId].push_back({stats.nextHandle(), std::move(message)});
+        if (scheduledPosts.insert(action.actionId).second) {
+            schedule.emplace(action.timestamp, action);
+            conditionVariable.notify_one();
+        }
+    }
+
+    SkyhookTransport &getTransport() {
+        return *transport;
+    }
+
+    /**
+     * @brief Get the GET requests the user model's fetch actions and the links' own drains made,
+     * which the request budget limits.
+     */
+    uint64_t getScheduledRequests() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return scheduledRequests;
+    }
+
+    /**
+     * @brief Get how many requests over the request budget the user model may be when a run ends,
+     * for the bursts and drains it hasn't yet paid for with later fetches of each link.
+     */
+    uint64_t getRequestBudgetSlack(double pollingInterval) {
+        int burstFetches = 0;
+        for (double interval = BURST_INITIAL_INTERVAL; interval < pollingInterval; interval *= 2) {
+            ++burstFetches;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t slack = 0;
+        for (auto &entry : fetchRequests) {
+            // Each timeline may also start with a fetch of every link
+            slack += (burstFetches + 1) * entry.second + largestDrainRequests;
+        }
+        return slack;
+    }
+
+private:
+    struct Message {
+        RaceHandle handle;
+        std::vector<uint8_t> content;
+    };
+
+    static ChannelProperties channelProperties(const LoadTestConfig &config) {
+        ChannelProperties properties = mockSkyhookChannelProperties();
+        properties.maxLinks = std::max(properties.maxLinks, config.links);
+        properties.currentRole.roleName = "default";
+        properties.currentRole.linkSide = LS_BOTH;
+        return properties;
+    }
+
+    void startComponents() {
+        userModel = std::make_unique<SkyhookBaseUserModel>(&userModelSdk);
+        answerUserInput(userModelSdk, *userModel);
+        if (accountHolder) {
+            auto accountHolderTransport =
+                std::make_unique<SkyhookTransportAccountHolder>(&transportSdk, "default");
+            answerUserInput(transportSdk, *accountHolderTransport);
+            transport = std::move(accountHolderTransport);
+        } else {
+            transport = std::make_unique<SkyhookTransportPublicUser>(&transportSdk, "default");
+            answerUserInput(transportSdk, *transport);
+        }
+        if (transportSdk.getState() != COMPONENT_STATE_STARTED or
+            userModelSdk.getState() != COMPONENT_STATE_STARTED) {
+            throw std::runtime_error(name + ": components failed to start");
+        }
+    }
+
+    void runActions() {
+        std::unique_lock<std::mutex> lock(mutex);
+        Timestamp nextRefresh = 0;
+        while (running) {
+            Timestamp now = currentTimestamp();
+            if (timelineUpdated or now >= nextRefresh) {
+                timelineUpdated = false;
+                lock.unlock();
+                UserModelProperties properties = userModel->getUserModelProperties();
+                ActionTimeline timeline = userModel->getTimeline(now, now + properties.timelineLength);
+                lock.lock();
+                std::unordered_set<uint64_t> timelineFetches;
+                for (auto &action : timeline) {
+                    timelineFetches.insert(action.actionId);
+                    if (knownFetches.emplace(action.actionId, action.timestamp).second) {
+                        schedule.emplace(action.timestamp, action);
+                    }
+                }
+                // Like the framework, cancel the fetches the user model took out of its timeline
+                for (auto iter = schedule.begin(); iter != schedule.end();) {
+                    uint64_t actionId = iter->second.actionId;
+                    bool cancelled = scheduledPosts.count(actionId) == 0 and
+                                     timelineFetches.count(actionId) == 0;
+                    iter = cancelled ? schedule.erase(iter) : ++iter;
+                }
+                // Fetches from before the start of the timeline are never returned again
+                for (auto iter = knownFetches.begin(); iter != knownFetches.end();) {
+                    iter = iter->second < now - properties.timelineLength ? knownFetches.erase(iter) :
+                                                                            ++iter;
+                }
+                nextRefresh = now + properties.timelineFetchPeriod;
+                continue;
+            }
+
+            if (not schedule.empty() and schedule.begin()->first <= now) {
+                Action action = schedule.begin()->second;
+                schedule.erase(schedule.begin());
+                std::vector<Message> messages;
+                auto iter = postMessages.find(action.actionId);
+                if (iter != postMessages.end()) {
+                    messages = std::move(iter->second);
+                    postMessages.erase(iter);
+                    scheduledPosts.erase(action.actionId);
+                }
+                lock.unlock();
+                execute(action, messages);
+                lock.lock();
+                continue;
+            }
+
+            Timestamp wakeup = nextRefresh;
+            if (not schedule.empty()) {
+                wakeup = std::min(wakeup, schedule.begin()->first);
+            }
+            conditionVariable.wait_for(lock, std::chrono::duration<double>(wakeup - now));
+        }
+    }
+
+    void execute(const Action &action, const std::vector<Message> &messages) {
+        std::vector<EncodingParameters> params = transport->getActionParams(action);
+        std::vector<RaceHandle> handles;
+        ActionJson actionJson = nlohmann::json::parse(action.json);
+        if (actionJson.type == ACTION_FETCH) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto iter = fetchRequests.find(actionJson.linkId);
+            scheduledRequests += iter == fetchRequests.end() ? 1 : iter->second;
+        }
+        if (not params.empty()) {
+            if (messages.empty()) {
+                return;
+            }
+            std::vector<uint8_t> content;
+            for (auto &message : messages) {
+                content.insert(content.end(), message.content.begin(), message.content.end());
+                handles.push_back(message.handle);
+            }
+            for (auto &param : params) {
+                transport->enqueueContent(param, action, content);
+            }
+        }
+        transport->doAction(handles, action);
+    }
+
+    std::string name;
+    bool accountHolder;
+    std::string linkParams;
+    LoadStats &stats;
+    MockTransportSdk transportSdk;
+    MockUserModelSdk userModelSdk;
+    std::unique_ptr<SkyhookBaseUserModel> userModel;
+    std::unique_ptr<SkyhookTransport> transport;
+    // Address each link was created or loaded from, to restore it after a restart
+    std::vector<std::pair<LinkID, std::string>> linkAddresses;
+
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+    bool running{false};
+    bool timelineUpdated{false};
+    std::thread actionThread;
+    // Actions by the time they are due
+    std::multimap<Timestamp, Action> schedule;
+    // Fetch actions scheduled or already executed, by ID, with the time they were due
+    std::unordered_map<uint64_t, Timestamp> knownFetches;
+    // Post actions scheduled, and the messages each of them will post
+    std::unordered_set<uint64_t> scheduledPosts;
+    std::unordered_map<uint64_t, std::vector<Message>> postMessages;
+    // Requests every fetch of each link makes, from the transport's link parameters
+    std::unordered_map<LinkID, int> fetchRequests;
+    uint64_t scheduledRequests{0};
+    int largestDrainRequests{0};
+};
+
+/**
+ * @brief Get a field of /proc/self/status in bytes, e.g. VmRSS
+ */
+static uint64_t procStatusBytes(const std::string &field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind(field + ":", 0) == 0) {
+            std::istringstream value(line.substr(field.size() + 1));
+            uint64_t kilobytes = 0;
+            value >> kilobytes;
+            return kilobytes * 1024;
+        }
+    }
+    return 0;
+}
+
+static void printUsage(const char *program) {
+    std::cerr
+        << "Usage: " << program << " [options]\n"
+        << "  --links=N               Number of links (default 10)\n"
+        << "  --message-size=BYTES    Size of each message (default 1024)\n"
+        << "  --rate=N                Messages per second on each link in each direction\n"
+        << "                          (default 0.2)\n"
+        << "  --direction=DIR         up (public user to account holder), down, or both\n"
+        << "                          (default both)\n"
+        << "  --duration=SECONDS      How long to send messages for (default 60)\n"
+        << "  --drain=SECONDS         How long to wait for messages in flight (default 30)\n"
+        << "  --restart-at=SECONDS    Tear down both ends this far into the run and restore\n"
+        << "                          their links. The test fails if a posted message is\n"
+        << "                          lost or delivered twice.\n"
+        << "  --latency-ms=MS         Delay added to every object store response (default 0)\n"
+        << "  --latency-jitter-ms=MS  Uniform jitter of the delay either way (default 0)\n"
+        << "  --loss=FRACTION         Fraction of object store requests dropped (default 0)\n"
+        << "  --port=PORT             Port of the local object store (default any)\n"
+        << "  --link-params=JSON      Link parameters given to the user models (default {})\n"
+        << "  --request-budget=RATE   Request budget of each user model, e.g. 10/s. The test\n"
+        << "                          fails if either end schedules more requests.\n"
+        << "  --report=FILE           Write a JSON report to FILE\n"
+        << "  --trace=FILE            Write a Chrome trace of the packages to FILE\n"
+        << "  --trace-sample-rate=F   Fraction of packages traced (default 1)\n"
+        << "  --log-level=LEVEL       trace, debug, info, warning, or error (default error)\n";
+}
+
+static bool parseArgs(int argc, char **argv, LoadTestConfig &config) {
+    for (int idx = 1; idx < argc; ++idx) {
+        std::string arg = argv[idx];
+        size_t equals = arg.find('=');
+        if (arg.rfind("--", 0) != 0 or equals == std::string::npos) {
+            std::cerr << "Invalid argument: " << arg << "\n";
+            return false;
+        }
+        std::string name = arg.substr(2, equals - 2);
+        std::string value = arg.substr(equals + 1);
+        try {
+            if (name == "links") {
+                config.links = std::stoi(value);
+            } else if (name == "message-size") {
+                config.messageSize = std::stoul(value);
+            } else if (name == "rate") {
+                config.rate = std::stod(value);
+            } else if (name == "direction") {
+                if (value != "up" and value != "down" and value != "both") {
+                    throw std::invalid_argument(value);
+                }
+                config.upstream = value != "down";
+                config.downstream = value != "up";
+            } else if (name == "duration") {
+                config.duration = std::stod(value);
+            } else if (name == "drain") {
+                config.drain = std::stod(value);
+            } else if (name == "restart-at") {
+                config.restartAt = std::stod(value);
+            } else if (name == "latency-ms") {
+                config.store.latency = std::chrono::milliseconds(std::stol(value));
+            } else if (name == "latency-jitter-ms") {
+                config.store.latencyJitter = std::chrono::milliseconds(std::stol(value));
+            } else if (name == "loss") {
+                config.store.loss = std::stod(value);
+            } else if (name == "port") {
+                config.store.port = std::stoi(value);
+            } else if (name == "link-params") {
+                if (not nlohmann::json::accept(value)) {
+                    throw std::invalid_argument(value);
+                }
+                config.linkParams = value;
+            } else if (name == "request-budget") {
+                config.requestBudget = value;
+            } else if (name == "report") {
+                config.reportFile = value;
+            } else if (name == "trace") {
+                config.traceFile = value;
+            } else if (name == "trace-sample-rate") {
+                config.traceSampleRate = std::stod(value);
+            } else if (name == "log-level") {
+                if (not parseLogLevel(value, config.logLevel)) {
+                    throw std::invalid_argument(value);
+                }
+            } else {
+                std::cerr << "Unknown option: " << name << "\n";
+                return false;
+            }
+        } catch (std::exception &error) {
+            std::cerr << "Invalid value for " << name << ": " << value << "\n";
+            return false;
+        }
+    }
+    double requestsPerSecond;
+    if (not RequestBudget::parse(config.requestBudget, requestsPerSecond)) {
+        std::cerr << "Invalid value for request-budget: " << config.requestBudget << "\n";
+        return false;
+    }
+    return config.links > 0 and config.rate >= 0 and config.duration > 0 and
+           config.restartAt >= 0 and config.restartAt < config.duration;
+}
+
+/**
+ * @brief Send messages on every link in the enabled directions until the duration has passed.
+ * Message arrivals on each link are a Poisson process, so sends on different links don't line up.
+ */
+static void generateMessages(const LoadTestConfig &config, double duration, LoadStats &stats,
+                             const std::vector<LinkID> &linkIds, Node &publicUser,
+                             Node &accountHolder) {
+    struct Source {
+        double due;
+        Node *sender;
+        const LinkID *linkId;
+        bool operator>(const Source &other) const {
+            return due > other.due;
+        }
+    };
+    std::priority_queue<Source, std::vector<Source>, std::greater<Source>> sources;
+    std::mt19937_64 generator{std::random_device{}()};
+    std::exponential_distribution<double> interval(config.rate > 0 ? config.rate : 1);
+    if (config.rate > 0) {
+        for (auto &linkId : linkIds) {
+            if (config.upstream) {
+                sources.push({interval(generator), &publicUser, &linkId});
+            }
+            if (config.downstream) {
+                sources.push({interval(generator), &accountHolder, &linkId});
+            }
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto nextProgress = start + PROGRESS_PERIOD;
+    while (not sources.empty() and sources.top().due < duration) {
+        Source source = sources.top();
+        sources.pop();
+        auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>(source.due));
+        std::this_thread::sleep_until(due);
+        source.sender->send(*source.linkId, stats.makeMessage(*source.linkId, config.messageSize));
+        source.due += interval(generator);
+        sources.push(source);
+
+        if (std::chrono::steady_clock::now() >= nextProgress) {
+            nextProgress += PROGRESS_PERIOD;
+            std::cout << "  " << std::chrono::duration_cast<std::chrono::seconds>(due - start).count()
+                      << " s: generated " << stats.generated.get() << ", delivered "
+                      << stats.delivered.get() << std::endl;
+        }
+    }
+    std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                              std::chrono::duration<double>(duration)));
+}
+
+int main(int argc, char **argv) {
+    LoadTestConfig config;
+    if (not parseArgs(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    setLogLevel(config.logLevel);
+    // A peer closing its end of a connection mustn't kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    MetricsRegistry metrics;
+    LoadStats stats(metrics);
+    LocalObjectStore store(metrics, config.store);
+    try {
+        store.start();
+    } catch (std::runtime_error &error) {
+        std::cerr << "Failed to start the local object store: " << error.what() << "\n";
+        return 1;
+    }
+    // Both transports talk to the local store. The account holder's S3 client needs credentials
+    // to sign its requests, but the store doesn't check them.
+    setenv(S3_ENDPOINT_ENV_VAR, store.getEndpoint().c_str(), 1);
+    setenv("AWS_ACCESS_KEY_ID", "skyhook-load-test", 0);
+    setenv("AWS_SECRET_ACCESS_KEY", "skyhook-load-test", 0);
+    setenv("AWS_EC2_METADATA_DISABLED", "true", 1);
+
+    Aws::SDKOptions options;
+    Aws::InitAPI(options);
+    int result = 0;
+    try {
+        auto accountHolder = std::make_unique<Node>("account-holder", true, config, stats);
+        auto publicUser = std::make_unique<Node>("public-user", false, config, stats);
+
+        std::cout << "Creating " << config.links << " links on " << store.getEndpoint()
+                  << std::endl;
+        std::vector<LinkID> linkIds;
+        std::vector<nlohmann::json> addresses;
+        for (int idx = 0; idx < config.links; ++idx) {
+            LinkID linkId = "load-test-link-" + std::to_string(idx);
+            stats.addLink(linkId);
+            // The account holder reaches the store through SKYHOOK_S3_ENDPOINT, and the public
+            // user through the endpoint in the address
+            nlohmann::json address = nlohmann::json::parse(accountHolder->createLink(linkId));
+            address["endpoint"] = store.getEndpoint();
+            publicUser->loadLink(linkId, address.dump());
+            linkIds.push_back(linkId);
+            addresses.push_back(std::move(address));
+        }
+        // Links share the bucket, so creating one mustn't take away the permissions of the others.
+        // The store doesn't enforce policies, so check them directly.
+        for (size_t idx = 0; idx < addresses.size(); ++idx) {
+            std::string policy = store.getBucketPolicy(addresses[idx]["fetchBucket"]);
+            if (policy.find(addresses[idx]["initialFetchObjUuid"].get<std::string>()) ==
+                std::string::npos) {
+                throw std::runtime_error("bucket policy lacks the objects of " + linkIds[idx]);
+            }
+        }
+        uint64_t setupRequests = metrics.counter("store_request_count").get();
+
+        std::cout << "Sending " << config.messageSize << " byte messages at " << config.rate
+                  << "/s per link for " << config.duration << " s" << std::endl;
+        auto start = std::chrono::steady_clock::now();
+        accountHolder->start();
+        publicUser->start();
+        if (config.restartAt > 0) {
+            generateMessages(config, config.restartAt, stats, linkIds, *publicUser,
+                             *accountHolder);
+            std::cout << "Restarting both ends" << std::endl;
+            accountHolder->restart();
+            publicUser->restart();
+            generateMessages(config, config.duration - config.restartAt, stats, linkIds,
+                             *publicUser, *accountHolder);
+        } else {
+            generateMessages(config, config.duration, stats, linkIds, *publicUser, *accountHolder);
+        }
+
+        // Wait for the messages still in flight, as long as some are still arriving. Messages
+        // that failed to post never will.
+        auto drainEnd = std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(config.drain));
+        while (stats.delivered.get() < stats.generated.get() - stats.postFailed.get() and
+               std::chrono::steady_clock::now() < drainEnd) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        double elapsed =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        publicUser->stop();
+        accountHolder->stop();
+
+        // Each end's fetches and drains must keep to its request budget, if any
+        double budget = 0;
+        RequestBudget::parse(config.requestBudget, budget);
+        double pollingInterval =
+            nlohmann::json::parse(config.linkParams)
+                .value("polling_interval_ms", DEFAULT_POLLING_INTERVAL * 1000) /
+            1000.0;
+        uint64_t publicUserRequests = publicUser->getScheduledRequests();
+        uint64_t accountHolderRequests = accountHolder->getScheduledRequests();
+        bool withinBudget = true;
+        if (budget > 0) {
+            for (auto node : {std::make_pair(publicUser.get(), publicUserRequests),
+                              std::make_pair(accountHolder.get(), accountHolderRequests)}) {
+                double limit = budget * elapsed + node.first->getRequestBudgetSlack(pollingInterval);
+                withinBudget = withinBudget and node.second <= limit;
+            }
+        }
+
+        uint64_t generated = stats.generated.get();
+        uint64_t delivered = stats.delivered.get();
+        double deliveredRatio = generated == 0 ? 1.0 : static_cast<double>(delivered) / generated;
+        uint64_t requests = metrics.counter("store_request_count").get() - setupRequests;
+        // The bucket owner pays for the requests of both ends
+        auto publicUserCost = publicUser->getTransport().requestLedger.project();
+        auto accountHolderCost = accountHolder->getTransport().requestLedger.project();
+        double requestsPerHour =
+            publicUserCost.totalRequestsPerHour + accountHolderCost.totalRequestsPerHour;
+        double costPerMonth = publicUserCost.usdPerMonth + accountHolderCost.usdPerMonth;
+        uint64_t rss = procStatusBytes("VmRSS");
+        uint64_t peakRss = procStatusBytes("VmHWM");
+
+        nlohmann::json results = {
+            {"elapsed_s", elapsed},
+            {"generated", generated},
+            {"posted", stats.posted.get()},
+            {"post_failed", stats.postFailed.get()},
+            {"delivered", delivered},
+            {"delivered_ratio", deliveredRatio},
+            {"duplicates", stats.duplicates.get()},
+            {"malformed", stats.malformed.get()},
+            {"misrouted", stats.misrouted.get()},
+            {"throughput_messages_per_s", delivered / elapsed},
+            {"throughput_bytes_per_s", stats.deliveredBytes.get() / elapsed},
+            {"latency_p50_ms", stats.latency.getQuantile(0.5) / 1000.0},
+            {"latency_p99_ms", stats.latency.getQuantile(0.99) / 1000.0},
+            {"latency_max_ms", stats.latency.getMax() / 1000.0},
+            {"public_user_scheduled_requests", publicUserRequests},
+            {"account_holder_scheduled_requests", accountHolderRequests},
+            {"within_request_budget", withinBudget},
+            {"store_requests", requests},
+            {"store_requests_per_s", requests / elapsed},
+            {"store_objects", store.getObjectCount()},
+            {"projected_s3_requests_per_hour", requestsPerHour},
+            {"projected_s3_cost_per_month_usd", costPerMonth},
+            {"rss_bytes", rss},
+            {"peak_rss_bytes", peakRss},
+        };
+
+        std::cout << "\nMessages: generated " << generated << ", posted " << stats.posted.get()
+                  << ", post failures " << stats.postFailed.get() << ", delivered " << delivered
+                  << " (" << deliveredRatio * 100 << "%), duplicates "
+                  << stats.duplicates.get() << ", misrouted " << stats.misrouted.get() << "\n"
+                  << "Throughput: " << delivered / elapsed << " messages/s, "
+                  << stats.deliveredBytes.get() / elapsed << " bytes/s\n"
+                  << "Delivery latency: p50 " << stats.latency.getQuantile(0.5) / 1000.0
+                  << " ms, p99 " << stats.latency.getQuantile(0.99) / 1000.0 << " ms, max "
+                  << stats.latency.getMax() / 1000.0 << " ms\n"
+                  << "Object store: " << requests << " requests (" << requests / elapsed
+                  << "/s) after setup, GET " << metrics.counter("store_get_count").get()
+                  << " (" << metrics.counter("store_get_miss_count").get() << " misses), PUT "
+                  << metrics.counter("store_put_count").get() << ", DELETE "
+                  << metrics.counter("store_delete_count").get() << ", policy writes "
+                  << metrics.counter("store_policy_write_count").get() << ", dropped "
+                  << metrics.counter("store_dropped_request_count").get() << "\n"
+                  << "Scheduled requests: public user " << publicUserRequests << ", account holder "
+                  << accountHolderRequests
+                  << (budget > 0 ? (withinBudget ? " (within budget)" : " (OVER BUDGET)") : "")
+                  << "\n"
+                  << "Projected S3 cost: " << requestsPerHour << " requests/hour, $"
+                  << costPerMonth << "/month\n"
+                  << "Memory: RSS " << rss / (1024 * 1024) << " MiB, peak "
+                  << peakRss / (1024 * 1024) << " MiB" << std::endl;
+
+        if (not config.reportFile.empty()) {
+            nlohmann::json report = {
+                {"config",
+                 {
+                     {"links", config.links},
+                     {"message_size", config.messageSize},
+                     {"rate", config.rate},
+                     {"upstream", config.upstream},
+                     {"downstream", config.downstream},
+                     {"duration_s", config.duration},
+                     {"drain_s", config.drain},
+                     {"restart_at_s", config.restartAt},
+                     {"latency_ms", config.store.latency.count()},
+                     {"latency_jitter_ms", config.store.latencyJitter.count()},
+                     {"loss", config.store.loss},
+                     {"link_params", nlohmann::json::parse(config.linkParams)},
+                     {"request_budget", config.requestBudget},
+                 }},
+                {"results", results},
+                {"metrics", nlohmann::json::parse(metrics.toJson())},
+                {"public_user_transport",
+                 nlohmann::json::parse(publicUser->getTransport().metrics.toJson())},
+                {"account_holder_transport",
+                 nlohmann::json::parse(accountHolder->getTransport().metrics.toJson())},
+                {"public_user_requests",
+                 nlohmann::json::parse(publicUser->getTransport().requestLedger.toJson())},
+                {"account_holder_requests",
+                 nlohmann::json::parse(accountHolder->getTransport().requestLedger.toJson())},
+            };
+            std::ofstream(config.reportFile) << report.dump(2) << std::endl;
+            std::cout << "Report written to " << config.reportFile << std::endl;
+        }
+        if (not config.traceFile.empty()) {
+            // Each end is its own process in the trace, with flows from posts to their fetches
+            nlohmann::json trace = nlohmann::json::parse(publicUser->getTransport().tracer.toJson());
+            auto accountHolderTrace =
+                nlohmann::json::parse(accountHolder->getTransport().tracer.toJson());
+            for (auto &event : accountHolderTrace["traceEvents"]) {
+                trace["traceEvents"].push_back(std::move(event));
+            }
+            std::ofstream(config.traceFile) << trace.dump() << std::endl;
+            std::cout << "Trace written to " << config.traceFile << std::endl;
+        }
+        // The links are shut down along with the transports, while the store is still up
+        publicUser.reset();
+        accountHolder.reset();
+        if (not withinBudget) {
+            std::cerr << "Load test failed: request budget exceeded\n";
+            result = 1;
+        }
+        if (stats.misrouted.get() > 0) {
+            std::cerr << "Load test failed: messages received on the wrong link\n";
+            result = 1;
+        }
+        // Restored links must resume from their checkpoints: fetching from an earlier object
+        // delivers messages again, and posting to one overwrites messages not yet fetched
+        if (config.restartAt > 0 and
+            (stats.duplicates.get() > 0 or stats.delivered.get() < stats.posted.get())) {
+            std::cerr << "Load test failed: messages lost or delivered twice across the restart\n";
+            result = 1;
+        }
+    } catch (std::exception &error) {
+        std::cerr << "Load test failed: " << error.what() << "\n";
+        result = 1;
+    }
+    Aws::ShutdownAPI(options);
+    store.stop();
+    return result;
+}
@@ -0,0 +1,197 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __SKYHOOK_MOCK_SDK_MOCK_COMPONENT_SDK_H__
+#define __SKYHOOK_MOCK_SDK_MOCK_COMPONENT_SDK_H__
+
+#include <ChannelProperties.h>
+#include <ComponentTypes.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief In-memory implementation of the SDK calls common to all components, for running
+ * components outside of a RACE node. Files are kept in memory and user input requests are
+ * answered from a preset map of responses.
+ *
+ * @tparam Interface SDK interface of the component, e.g. ITransportSdk or IUserModelSdk
+ */
+template <typename Interface>
+class MockComponentSdk : public Interface {
+public:
+    explicit MockComponentSdk(const ChannelProperties &channelProperties,
+                              const std::string &persona = "mock-persona") :
+        channelProperties(channelProperties), persona(persona) {}
+
+    /**
+     * @brief Set the response given to the user input request with the given key. Requests for
+     * keys without a response are reported as unanswered.
+     */
+    void setUserInputResponse(const std::string &key, const std::string &response) {
+        std::lock_guard<std::mutex> lock(mutex);
+        userInputResponses[key] = response;
+    }
+
+    /**
+     * @brief Get the user input requests made so far, by handle.
+     */
+    std::map<RaceHandle, std::string> getUserInputRequests() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return userInputRequests;
+    }
+
+    /**
+     * @brief Forget the user input requests made so far, when the component that made them is
+     * replaced by a new one.
+     */
+    void clearUserInputRequests() {
+        std::lock_guard<std::mutex> lock(mutex);
+        userInputRequests.clear();
+    }
+
+    /**
+     * @brief Look up the preset response to a user input request.
+     *
+     * @return true if the request has a preset response
+     */
+    bool getUserInputResponse(const std::string &key, std::string &response) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = userInputResponses.find(key);
+        if (iter == userInputResponses.end()) {
+            return false;
+        }
+        response = iter->second;
+        return true;
+    }
+
+    ComponentState getState() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return state;
+    }
+
+    std::string getActivePersona() override {
+        return persona;
+    }
+
+    ChannelProperties getChannelProperties() override {
+        return channelProperties;
+    }
+
+    ChannelResponse makeDir(const std::string & /* directoryPath */) override {
+        return ok();
+    }
+
+    ChannelResponse removeDir(const std::string &directoryPath) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto iter = files.begin(); iter != files.end();) {
+            iter = iter->first.rfind(directoryPath + "/", 0) == 0 ? files.erase(iter) : ++iter;
+        }
+        return ok();
+    }
+
+    std::vector<std::string> listDir(const std::string &directoryPath) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> entries;
+        for (auto &entry : files) {
+            if (entry.first.rfind(directoryPath + "/", 0) == 0) {
+                entries.push_back(entry.first.substr(directoryPath.size() + 1));
+            }
+        }
+        return entries;
+    }
+
+    std::vector<std::uint8_t> readFile(const std::string &filepath) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = files.find(filepath);
+        return iter == files.end() ? std::vector<std::uint8_t>{} : iter->second;
+    }
+
+    ChannelResponse appendFile(const std::string &filepath,
+                               const std::vector<std::uint8_t> &data) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &file = files[filepath];
+        file.insert(file.end(), data.begin(), data.end());
+        return ok();
+    }
+
+    ChannelResponse writeFile(const std::string &filepath,
+                              const std::vector<std::uint8_t> &data) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        files[filepath] = data;
+        return ok();
+    }
+
+    ChannelResponse requestPluginUserInput(const std::string &key, const std::string & /* prompt */,
+                                           bool /* cache */) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        RaceHandle handle = nextHandle++;
+        userInputRequests[handle] = key;
+        return {CM_OK, handle};
+    }
+
+    ChannelResponse requestCommonUserInput(const std::string &key) override {
+        return requestPluginUserInput(key, "", true);
+    }
+
+    ChannelResponse updateState(ComponentState newState) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = newState;
+        return ok();
+    }
+
+protected:
+    ChannelResponse ok() {
+        return {CM_OK, NULL_RACE_HANDLE};
+    }
+
+    std::mutex mutex;
+    ChannelProperties channelProperties;
+    std::string persona;
+    ComponentState state{COMPONENT_STATE_INIT};
+    RaceHandle nextHandle{1};
+    std::map<RaceHandle, std::string> userInputRequests;
+    std::unordered_map<std::string, std::string> userInputResponses;
+    std::unordered_map<std::string, std::vector<std::uint8_t>> files;
+};
+
+/**
+ * @brief Channel properties matching the Skyhook channel manifest, for running components
+ * outside of a RACE node.
+ */
+inline ChannelProperties mockSkyhookChannelProperties() {
+    ChannelProperties properties{};
+    properties.channelGid = "skyhook";
+    properties.transmissionType = TT_UNICAST;
+    properties.connectionType = CT_INDIRECT;
+    properties.sendType = ST_STORED_ASYNC;
+    properties.reliable = false;
+    properties.maxLinks = 1000;
+    for (LinkPropertySet *expected :
+         {&properties.creatorExpected.send, &properties.creatorExpected.receive}) {
+        expected->bandwidth_bps = 277200;
+        expected->latency_ms = 3190;
+        expected->loss = 0;
+    }
+    properties.supported_hints = {"polling_interval_ms", "polling_jitter", "after", "priority",
+                                  "aggregation_window_ms"};
+    return properties;
+}
+
+#endif  // __SKYHOOK_MOCK_SDK_MOCK_COMPONENT_SDK_H__
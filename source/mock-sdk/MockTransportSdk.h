@@ -0,0 +1,71 @@
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __SKYHOOK_MOCK_SDK_MOCK_TRANSPORT_SDK_H__
+#define __SKYHOOK_MOCK_SDK_MOCK_TRANSPORT_SDK_H__
+
+#include <ITransportSdk.h>
+
+#include <functional>
+
+#include "MockComponentSdk.h"
+
+/**
+ * @brief Transport SDK that hands the transport's callbacks to handlers set by the caller. The
+ * handlers must be set before the transport is created and are called on the transport's threads.
+ */
+class MockTransportSdk : public MockComponentSdk<ITransportSdk> {
+public:
+    using MockComponentSdk<ITransportSdk>::MockComponentSdk;
+
+    ChannelResponse onLinkStatusChanged(RaceHandle handle, const LinkID &linkId, LinkStatus status,
+                                        const LinkParameters &params) override {
+        if (linkStatusHandler) {
+            linkStatusHandler(handle, linkId, status, params);
+        }
+        return ok();
+    }
+
+    ChannelResponse onPackageStatusChanged(RaceHandle handle, PackageStatus status) override {
+        if (packageStatusHandler) {
+            packageStatusHandler(handle, status);
+        }
+        return ok();
+    }
+
+    ChannelResponse onEvent(const Event &event) override {
+        if (eventHandler) {
+            eventHandler(event);
+        }
+        return ok();
+    }
+
+    ChannelResponse onReceive(const LinkID &linkId, const EncodingParameters &params,
+                              const std::vector<uint8_t> &bytes) override {
+        if (receiveHandler) {
+            receiveHandler(linkId, params, bytes);
+        }
+        return ok();
+    }
+
+    std::function<void(RaceHandle, const LinkID &, LinkStatus, const LinkParameters &)>
+        linkStatusHandler;
+    std::function<void(RaceHandle, PackageStatus)> packageStatusHandler;
+    std::function<void(const Event &)> eventHandler;
+    std::function<void(const LinkID &, const EncodingParameters &, const std::vector<uint8_t> &)>
+        receiveHandler;
+};
+
+#endif  // __SKYHOOK_MOCK_SDK_MOCK_TRANSPORT_SDK_H__
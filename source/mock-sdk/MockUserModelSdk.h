@@ -0,0 +1,47 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __SKYHOOK_MOCK_SDK_MOCK_USER_MODEL_SDK_H__
+#define __SKYHOOK_MOCK_SDK_MOCK_USER_MODEL_SDK_H__
+
+#include <IUserModelSdk.h>
+
+#include <atomic>
+#include <functional>
+
+#include "MockComponentSdk.h"
+
+/**
+ * @brief User model SDK that counts timeline updates and optionally passes them on to a handler
+ * set before the user model is created.
+ */
+class MockUserModelSdk : public MockComponentSdk<IUserModelSdk> {
+public:
+    using MockComponentSdk<IUserModelSdk>::MockComponentSdk;
+
+    ChannelResponse onTimelineUpdated() override {
+        ++timelineUpdates;
+        if (timelineUpdatedHandler) {
+            timelineUpdatedHandler();
+        }
+        return ok();
+    }
+
+    std::atomic<uint64_t> timelineUpdates{0};
+    std::function<void()> timelineUpdatedHandler;
+};
+
+#endif  // __SKYHOOK_MOCK_SDK_MOCK_USER_MODEL_SDK_H__
@@ -17,37 +17,157 @@
 
 #include "LinkUserModel.h"
 
+#include <algorithm>
+#include <cmath>
+#include <random>
+
 #include "JsonTypes.h"
+#include "log.h"
+
+// Names of the hints in the link parameters JSON, both in milliseconds
+static const char *POLLING_INTERVAL_HINT = "polling_interval_ms";
+static const char *AFTER_HINT = "after";
+
+// Name of the hint in the link parameters JSON giving the largest fraction of the polling interval
+// by which each fetch is randomly moved. Capped so fetches stay in order.
+static const char *POLLING_JITTER_HINT = "polling_jitter";
+static const double MAX_JITTER = 0.5;
+
+// Name of the hint in the link parameters JSON giving the link's relative share of the request
+// budget
+static const char *PRIORITY_HINT = "priority";
+
+// Name of the parameter the transport gives the number of requests every fetch makes in, more than
+// one if it probes ahead
+static const char *FETCH_REQUESTS_PARAM = "fetch_requests";
+
+// Time constant over which the recorded activity of a link decays, in seconds
+static const double ACTIVITY_DECAY_TIME = 60.0;
+
+// Name of the hint in the link parameters JSON giving the longest time in milliseconds to hold
+// posts for aggregation. Capped so latency-sensitive traffic is never held for long.
+static const char *AGGREGATION_WINDOW_HINT = "aggregation_window_ms";
+static const double MAX_AGGREGATION_WINDOW = 0.1;
+
+// Interval used when a link is allocated no requests at all
+static const double MAX_INTERVAL = 24 * 60 * 60;
+
+// Relative difference between the allocated and polling intervals below which a link isn't held
+// back by the request budget, since the allocated interval is recomputed from a rate
+static const double INTERVAL_TOLERANCE = 1e-6;
+
+// Relative shortening of the allocated interval at which the cached timeline is regenerated, rather
+// than only applying the new interval once the cached actions run out. Any lengthening is applied
+// straight away, or the link would overrun its share of the request budget in the meantime.
+static const double REALLOCATION_THRESHOLD = 0.1;
+
+/**
+ * @brief Read a numeric hint from the link parameters JSON
+ */
+static double readHint(const nlohmann::json &hints, const char *name, double defaultValue,
+                       double minValue) {
+    TRACE_FUNCTION(name);
+    if (not hints.is_object() or not hints.contains(name)) {
+        return defaultValue;
+    }
+    try {
+        double value = hints.at(name).get<double>();
+        if (value >= minValue) {
+            return value;
+        }
+        logWarning(logPrefix + "ignoring out of range " + name + " hint: " + hints.at(name).dump());
+    } catch (nlohmann::json::exception &error) {
+        logWarning(logPrefix + "ignoring invalid " + name + " hint: " + std::string(error.what()));
+    }
+    return defaultValue;
+}
 
-static const double WAIT_TIME = 1.0;
+// Fetch bursts start this soon after the triggering event and double the interval each time until
+// reaching the regular wait time
+static const double BURST_INITIAL_INTERVAL = 0.1;
 
-LinkUserModel::LinkUserModel(const LinkID &linkId, std::atomic<uint64_t> &nextActionId) :
-    linkId(linkId), nextActionId(nextActionId) {}
+LinkUserModel::LinkUserModel(const LinkID &linkId, std::atomic<uint64_t> &nextActionId,
+                             const LinkParameters &params, int sendBandwidth) :
+    linkId(linkId),
+    nextActionId(nextActionId),
+    fetchActionJson(nlohmann::json(ActionJson{linkId, ACTION_FETCH}).dump()),
+    postActionJson(nlohmann::json(ActionJson{linkId, ACTION_POST}).dump()),
+    pollInterval(DEFAULT_POLLING_INTERVAL),
+    jitter(0),
+    postDelay(0),
+    aggregationWindow(0),
+    sendBandwidth(sendBandwidth) {
+    TRACE_METHOD(linkId, params.json);
+    nlohmann::json hints;
+    if (not params.json.empty()) {
+        try {
+            hints = nlohmann::json::parse(params.json);
+        } catch (nlohmann::json::exception &error) {
+            logWarning(logPrefix + "ignoring invalid link parameters: " + std::string(error.what()));
+        }
+    }
+    // A zero polling interval would never advance the timeline
+    pollInterval = readHint(hints, POLLING_INTERVAL_HINT, DEFAULT_POLLING_INTERVAL * 1000, 1) / 1000.0;
+    postDelay = readHint(hints, AFTER_HINT, 0, 0) / 1000.0;
+    jitter = std::min(MAX_JITTER, readHint(hints, POLLING_JITTER_HINT, 0, 0));
+    priority = readHint(hints, PRIORITY_HINT, 1, 0.001);
+    fetchRequests = readHint(hints, FETCH_REQUESTS_PARAM, 1, 1);
+    aggregationWindow =
+        std::min(MAX_AGGREGATION_WINDOW, readHint(hints, AGGREGATION_WINDOW_HINT, 0, 0) / 1000.0);
+    allocatedInterval = pollInterval;
+    timelineInterval = pollInterval;
+    logInfo(logPrefix + "polling interval: " + std::to_string(pollInterval) +
+            " s, jitter: " + std::to_string(jitter) + ", post delay: " + std::to_string(postDelay) +
+            " s, priority: " + std::to_string(priority) +
+            ", fetch requests: " + std::to_string(fetchRequests) +
+            ", aggregation window: " + std::to_string(aggregationWindow) + " s");
+}
 
-ActionTimeline LinkUserModel::getTimeline(Timestamp start, Timestamp end) {
+const std::deque<Action> &LinkUserModel::getTimeline(Timestamp start, Timestamp end) {
     // First, remove all actions from the cached timeline that occur before the `start` time
-    auto iter = std::find_if(cachedTimeline.begin(), cachedTimeline.end(),
-                             [start](const auto &val) { return val.timestamp >= start; });
-    cachedTimeline.erase(cachedTimeline.begin(), iter);
+    while (not cachedTimeline.empty() and cachedTimeline.front().timestamp < start) {
+        cachedTimeline.pop_front();
+    }
+    while (not droppedFetches.empty() and droppedFetches.front() < start) {
+        droppedFetches.pop_front();
+    }
 
-    Timestamp current = start;
-    // If we still have cached actions, start at the timestamp of the last action
-    if (not cachedTimeline.empty()) {
-        current = cachedTimeline.back().timestamp + 10; // Delay starting to use links for 10s
+    // Start at this link's phase within the interval, so that links started together are spread out
+    Timestamp current = start + phase * allocatedInterval;
+    if (not cachedTimeline.empty() and intervalChanged()) {
+        // Keep the first action, which the previous timeline may have started with, and the latest
+        // burst, and generate the rest again at the new interval
+        Timestamp keepUntil = std::max(cachedTimeline.front().timestamp, burstEnd);
+        auto iter = std::upper_bound(cachedTimeline.begin(), cachedTimeline.end(), keepUntil,
+                                     [](Timestamp timestamp, const Action &action) {
+                                         return timestamp < action.timestamp;
+                                     });
+        cachedTimeline.erase(iter, cachedTimeline.end());
+        current = cachedTimeline.back().timestamp + nextInterval();
+        // Fetches dropped after the kept actions would come back, so drop as many again
+        fetchDebt += std::count_if(droppedFetches.begin(), droppedFetches.end(),
+                                   [keepUntil](Timestamp dropped) { return dropped > keepUntil; });
+        droppedFetches.clear();
+    } else if (not cachedTimeline.empty()) {
+        // If we still have cached actions, start at the timestamp of the last action, or of the
+        // fetches dropped after it
+        current = std::max(cachedTimeline.back().timestamp, generatedUntil) + 10; // Delay starting to use links for 10s
     }
+    timelineInterval = allocatedInterval;
 
     // Then add new actions to the timeline until we reach the `end` time
     while (current < end) {
-        nlohmann::json fetchAction = ActionJson{
-          linkId,
-          ACTION_FETCH
-        };
-        cachedTimeline.push_back({
-            current,
-            ++nextActionId,
-            fetchAction.dump(),
-          });
-        current += WAIT_TIME;
+        if (fetchDebt > 0) {
+            --fetchDebt;
+        } else {
+            cachedTimeline.push_back({
+                current,
+                ++nextActionId,
+                fetchActionJson,
+              });
+        }
+        generatedUntil = current;
+        current += nextInterval();
 
         // nlohmann::json postAction = ActionJson{
         //   linkId,
@@ -64,3 +184,145 @@ ActionTimeline LinkUserModel::getTimeline(Timestamp start, Timestamp end) {
 
     return cachedTimeline;
 }
+
+bool LinkUserModel::addFetchBurst(Timestamp after, bool charged) {
+    // Bursts come on top of the regular fetches, so only burst when the request budget isn't
+    // already holding this link back
+    if (cachedTimeline.empty() or budgetLimited) {
+        return false;
+    }
+    // A burst still under way already polls eagerly, and events come in runs
+    if (after < burstEnd) {
+        return false;
+    }
+    // Until the fetches charged so far are paid for, another burst would only add to them
+    if (charged and fetchDebt > 0) {
+        return false;
+    }
+    // Appending past the end would shift where the next call to getTimeline picks up
+    Timestamp last = cachedTimeline.back().timestamp;
+
+    int added = 0;
+    Timestamp current = after;
+    for (double interval = BURST_INITIAL_INTERVAL; interval < pollInterval; interval *= 2) {
+        current += interval;
+        if (current >= last) {
+            break;
+        }
+        auto iter = std::upper_bound(cachedTimeline.begin(), cachedTimeline.end(), current,
+                                     [](Timestamp timestamp, const Action &action) {
+                                         return timestamp < action.timestamp;
+                                     });
+        cachedTimeline.insert(iter, {current, ++nextActionId, fetchActionJson});
+        burstEnd = std::max(burstEnd, current);
+        ++added;
+    }
+    // Pay for the burst with the regular fetches following it, so the link keeps to its share
+    if (charged) {
+        dropFetches(added, burstEnd);
+    }
+    return added > 0;
+}
+
+bool LinkUserModel::chargeRequests(int requests, Timestamp after) {
+    requestDebt += requests;
+    int fetches = static_cast<int>(requestDebt / fetchRequests);
+    requestDebt -= fetches * fetchRequests;
+    return dropFetches(fetches, after) > 0;
+}
+
+int LinkUserModel::dropFetches(int fetches, Timestamp after) {
+    auto iter = std::upper_bound(cachedTimeline.begin(), cachedTimeline.end(), after,
+                                 [](Timestamp timestamp, const Action &action) {
+                                     return timestamp < action.timestamp;
+                                 });
+    // Never drop the last action, it is where the next call to getTimeline picks up
+    int removable = std::max<int>(0, std::distance(iter, cachedTimeline.end()) - 1);
+    int removed = std::min(fetches, removable);
+    for (auto dropped = iter; dropped != iter + removed; ++dropped) {
+        droppedFetches.insert(std::upper_bound(droppedFetches.begin(), droppedFetches.end(),
+                                               dropped->timestamp),
+                              dropped->timestamp);
+    }
+    cachedTimeline.erase(iter, iter + removed);
+    // Whatever can't be dropped now is dropped from the part generated next
+    fetchDebt += fetches - removed;
+    return removed;
+}
+
+double LinkUserModel::transmissionTime(int bytes) const {
+    if (sendBandwidth <= 0) {
+        return 0;
+    }
+    return bytes * 8.0 / sendBandwidth;
+}
+
+Action LinkUserModel::getPostAction(Timestamp now, int bytes) {
+    if (postDelay > 0) {
+        if (pendingPost.timestamp <= now) {
+            pendingPost = {now + postDelay, ++nextActionId, postActionJson};
+        }
+        return pendingPost;
+    }
+
+    if (aggregationWindow > 0) {
+        // Join the post still being held, unless the combined content would take as long to
+        // transmit as the window
+        if (pendingPost.timestamp > now and
+            transmissionTime(pendingBytes + bytes) < aggregationWindow) {
+            pendingBytes += bytes;
+            return pendingPost;
+        }
+        // Large packages gain little from sharing a post, so they are held for less time
+        double window = aggregationWindow - transmissionTime(bytes);
+        if (window > 0) {
+            pendingPost = {now + window, ++nextActionId, postActionJson};
+            pendingBytes = bytes;
+            return pendingPost;
+        }
+    }
+
+    // A timestamp of 0 posts as soon as possible
+    return {0, ++nextActionId, postActionJson};
+}
+
+void LinkUserModel::recordActivity(Timestamp now) {
+    activity = activity * std::exp((lastActivity - now) / ACTIVITY_DECAY_TIME) + 1;
+    lastActivity = now;
+}
+
+RequestBudget::Demand LinkUserModel::getDemand(Timestamp now) const {
+    double recentActivity = activity * std::exp((lastActivity - now) / ACTIVITY_DECAY_TIME);
+    return {fetchRequests / pollInterval, priority * (1 + recentActivity)};
+}
+
+bool LinkUserModel::setAllocatedRate(double requestsPerSecond) {
+    if (requestsPerSecond * MAX_INTERVAL <= fetchRequests) {
+        allocatedInterval = MAX_INTERVAL;
+    } else {
+        allocatedInterval = std::max(pollInterval, fetchRequests / requestsPerSecond);
+    }
+    budgetLimited = allocatedInterval > pollInterval * (1 + INTERVAL_TOLERANCE);
+    return not cachedTimeline.empty() and intervalChanged();
+}
+
+bool LinkUserModel::intervalChanged() const {
+    if (allocatedInterval > timelineInterval * (1 + INTERVAL_TOLERANCE)) {
+        return true;
+    }
+    return timelineInterval - allocatedInterval > timelineInterval * REALLOCATION_THRESHOLD;
+}
+
+void LinkUserModel::setPhase(double phase) {
+    this->phase = phase;
+}
+
+double LinkUserModel::nextInterval() {
+    if (jitter <= 0) {
+        return allocatedInterval;
+    }
+    // Symmetric, so the average rate is unchanged
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    std::uniform_real_distribution<double> distribution(-jitter, jitter);
+    return allocatedInterval * (1 + distribution(generator));
+}
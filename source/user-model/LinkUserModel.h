@@ -21,25 +21,181 @@
 #include <ComponentTypes.h>
 
 #include <atomic>
+#include <deque>
+#include <string>
+
+#include "RequestBudget.h"
+
+// Time between regular fetches of links without a polling_interval_ms hint, in seconds
+const double DEFAULT_POLLING_INTERVAL = 1.0;
 
 class LinkUserModel {
 public:
-    explicit LinkUserModel(const LinkID &linkId, std::atomic<uint64_t> &nextActionId);
+    /**
+     * @brief Constructor
+     *
+     * @param linkId ID of the link
+     * @param nextActionId Counter shared by all links to generate unique action IDs
+     * @param params Link parameters, whose JSON may contain the polling_interval_ms,
+     * polling_jitter, after, priority, and aggregation_window_ms hints, and the fetch_requests
+     * the transport makes for every fetch
+     * @param sendBandwidth Expected send bandwidth of the channel in bits per second, or -1 if
+     * unknown
+     */
+    LinkUserModel(const LinkID &linkId, std::atomic<uint64_t> &nextActionId,
+                  const LinkParameters &params, int sendBandwidth);
     virtual ~LinkUserModel() {}
 
     /**
      * @brief Get the action timeline for this link between the specified start and end timestamps.
+     * Actions already generated by a previous call are kept, only the missing tail is generated,
+     * unless the allocated rate dropped, or rose far enough, to regenerate all but the first action
+     * and bursts.
      *
      * @param start Timestamp at which to start
      * @param end Timestamp at which to end
-     * @return Action timeline
+     * @return Action timeline, sorted by timestamp, valid until the next call
+     */
+    virtual const std::deque<Action> &getTimeline(Timestamp start, Timestamp end);
+
+    /**
+     * @brief Schedule a burst of fetches after the given time, starting quickly and decaying back to
+     * the regular cadence. Only the already generated part of the timeline is affected, and nothing
+     * is added while an earlier burst is still under way.
+     *
+     * @param after Timestamp after which to schedule the burst
+     * @param charged Whether the burst comes out of the link's share of the request budget, in which
+     * case as many of the regular fetches following it are dropped, and no burst is added while
+     * fetches charged earlier are yet to be dropped
+     * @return true if any fetches were added to the timeline
+     */
+    virtual bool addFetchBurst(Timestamp after, bool charged);
+
+    /**
+     * @brief Charge requests the link made on its own to its request budget, by dropping as many
+     * of its next scheduled fetches after the given time as make that many requests. Whatever
+     * can't be dropped from the already generated part of the timeline is dropped from the part
+     * generated next.
+     *
+     * @param requests Number of requests to charge
+     * @param after Timestamp after which fetches may be dropped
+     * @return true if any fetches were removed from the timeline
+     */
+    virtual bool chargeRequests(int requests, Timestamp after);
+
+    /**
+     * @brief Get the post action to use for a package sent on this link. If the link defers posts,
+     * packages sent before a deferred post is due share that post so that they can be batched.
+     * Otherwise, if the link aggregates posts, small packages are held for a short window sized
+     * from their transmission time so that packages following close behind share the post.
+     *
+     * @param now Current timestamp
+     * @param bytes Size of the package
+     * @return Post action
+     */
+    virtual Action getPostAction(Timestamp now, int bytes);
+
+    /**
+     * @brief Record that content was posted to or received on this link, which raises its share of
+     * the request budget for a while.
+     *
+     * @param now Current timestamp
+     */
+    virtual void recordActivity(Timestamp now);
+
+    /**
+     * @brief Get this link's demand on the request budget.
+     *
+     * @param now Current timestamp
+     * @return Demand on the request budget
      */
-    virtual ActionTimeline getTimeline(Timestamp start, Timestamp end);
+    virtual RequestBudget::Demand getDemand(Timestamp now) const;
+
+    /**
+     * @brief Set the request rate allocated to this link from the request budget. Fetches are
+     * never scheduled more often than the polling interval, regardless of the allocated rate.
+     *
+     * @param requestsPerSecond Allocated rate
+     * @return true if the already generated part of the timeline will be regenerated at the new
+     * rate by the next call to getTimeline
+     */
+    virtual bool setAllocatedRate(double requestsPerSecond);
+
+    /**
+     * @brief Set the phase of this link's fetches within the polling interval, so that links
+     * started at the same time don't all fetch at the same instant.
+     *
+     * @param phase Fraction of the polling interval to delay the first fetch by, in [0, 1)
+     */
+    virtual void setPhase(double phase);
 
 private:
     LinkID linkId;
     std::atomic<uint64_t> &nextActionId;
-    ActionTimeline cachedTimeline;
+    std::deque<Action> cachedTimeline;
+
+    // Every fetch action of this link has the same payload, so it is only serialized once
+    std::string fetchActionJson;
+    std::string postActionJson;
+
+    // Time between regular fetches, from the polling_interval_ms hint
+    double pollInterval;
+
+    // Requests every fetch makes, from the fetch_requests parameter
+    double fetchRequests;
+
+    // Time between regular fetches allowed by the request budget, never less than pollInterval
+    double allocatedInterval;
+
+    // Whether the request budget holds this link back to less than its polling interval allows
+    bool budgetLimited{false};
+
+    // Allocated interval the cached timeline was generated at
+    double timelineInterval;
+
+    // Timestamp of the last fetch of the latest burst
+    Timestamp burstEnd{0};
+
+    // Timestamp of the last regular fetch generated, including those dropped for debt, which is
+    // where the next call to getTimeline picks up
+    Timestamp generatedUntil{0};
+
+    // Fraction of the interval to delay the first fetch by
+    double phase{0};
+
+    // Largest fraction of the interval by which each fetch is randomly moved, from the
+    // polling_jitter hint
+    double jitter;
+
+    // Relative share of the request budget, from the priority hint
+    double priority;
+
+    // Fetches charged to the link that are yet to be dropped from its timeline, and requests
+    // charged to it that don't yet add up to a whole fetch
+    int fetchDebt{0};
+    double requestDebt{0};
+
+    // Timestamps of the fetches dropped from the cached timeline, which come back if it is
+    // regenerated and so have to be dropped again
+    std::deque<Timestamp> droppedFetches;
+
+    // Decaying count of recent posts and receives, as of lastActivity
+    double activity{0};
+    Timestamp lastActivity{0};
+
+    // Time posts are deferred by, from the after hint
+    double postDelay;
+    Action pendingPost{0, 0, ""};
+
+    // Longest time a post is held to aggregate packages, from the aggregation_window_ms hint
+    double aggregationWindow;
+    int sendBandwidth;
+    int pendingBytes{0};
+
+    int dropFetches(int fetches, Timestamp after);
+    double transmissionTime(int bytes) const;
+    bool intervalChanged() const;
+    double nextInterval();
 };
 
 #endif  // __SKYHOOK_USER_MODEL_LINK_USER_MODEL_H__
@@ -0,0 +1,99 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "RequestBudget.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+void RequestBudget::setRate(double requestsPerSecond) {
+    rate = std::max(0.0, requestsPerSecond);
+}
+
+double RequestBudget::getRate() const {
+    return rate;
+}
+
+std::vector<double> RequestBudget::allocate(const std::vector<Demand> &demands) const {
+    std::vector<double> rates(demands.size());
+    if (rate <= 0) {
+        for (size_t i = 0; i < demands.size(); ++i) {
+            rates[i] = demands[i].maxRate;
+        }
+        return rates;
+    }
+
+    // Water-filling: every link gets weight * level, capped at its maximum rate. Links that hit
+    // their cap first are the ones with the lowest maximum rate per unit of weight, so handle them
+    // in that order and share whatever they leave among the rest.
+    std::vector<size_t> order(demands.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&demands](size_t lhs, size_t rhs) {
+        return demands[lhs].maxRate / demands[lhs].weight <
+               demands[rhs].maxRate / demands[rhs].weight;
+    });
+
+    double remainingRate = rate;
+    double remainingWeight = 0;
+    for (auto &demand : demands) {
+        remainingWeight += demand.weight;
+    }
+    for (size_t index : order) {
+        const Demand &demand = demands[index];
+        double share = remainingRate * demand.weight / remainingWeight;
+        rates[index] = std::min(demand.maxRate, share);
+        remainingRate -= rates[index];
+        remainingWeight -= demand.weight;
+    }
+    return rates;
+}
+
+bool RequestBudget::parse(const std::string &budget, double &requestsPerSecond) {
+    static const std::unordered_map<std::string, double> periodSeconds = {
+        {"s", 1},
+        {"min", 60},
+        {"h", 60 * 60},
+        {"d", 24 * 60 * 60},
+        {"month", 30 * 24 * 60 * 60},
+    };
+
+    if (budget.empty() or budget == "unlimited") {
+        requestsPerSecond = 0;
+        return true;
+    }
+
+    auto slash = budget.find('/');
+    if (slash == std::string::npos) {
+        return false;
+    }
+    auto period = periodSeconds.find(budget.substr(slash + 1));
+    if (period == periodSeconds.end()) {
+        return false;
+    }
+    try {
+        size_t parsed = 0;
+        double count = std::stod(budget.substr(0, slash), &parsed);
+        if (parsed != slash or count <= 0) {
+            return false;
+        }
+        requestsPerSecond = count / period->second;
+    } catch (std::logic_error &) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+
+//
+// Copyright 2023 Two Six Technologies
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef __SKYHOOK_USER_MODEL_REQUEST_BUDGET_H__
+#define __SKYHOOK_USER_MODEL_REQUEST_BUDGET_H__
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Splits a transport-wide request rate across links. Each link asks for up to a maximum
+ * rate and is given a share of the budget proportional to its weight. The budget that links can't
+ * use is redistributed to the others, and the total never exceeds the budget.
+ */
+class RequestBudget {
+public:
+    /**
+     * @brief A link's demand on the budget
+     */
+    struct Demand {
+        // Highest rate the link would use, in requests per second
+        double maxRate;
+        // Relative share of the budget, must be positive
+        double weight;
+    };
+
+    /**
+     * @brief Set the budget.
+     *
+     * @param requestsPerSecond Budget in requests per second, 0 for unlimited
+     */
+    void setRate(double requestsPerSecond);
+
+    /**
+     * @brief Get the budget.
+     *
+     * @return Budget in requests per second, 0 for unlimited
+     */
+    double getRate() const;
+
+    /**
+     * @brief Split the budget across links.
+     *
+     * @param demands Demand of each link
+     * @return Rate allocated to each link, in the same order, in requests per second
+     */
+    std::vector<double> allocate(const std::vector<Demand> &demands) const;
+
+    /**
+     * @brief Parse a budget of the form <count>/<period>, where the period is one of s, min, h, d,
+     * or month. An empty string or "unlimited" means no budget.
+     *
+     * @param budget Budget string
+     * @param requestsPerSecond Set to the parsed budget, 0 for unlimited
+     * @return true if the budget was valid
+     */
+    static bool parse(const std::string &budget, double &requestsPerSecond);
+
+private:
+    double rate{0};
+};
+
+#endif  // __SKYHOOK_USER_MODEL_REQUEST_BUDGET_H__
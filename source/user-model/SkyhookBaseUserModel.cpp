@@ -18,40 +18,138 @@
 #include "SkyhookBaseUserModel.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <vector>
 
 #include "JsonTypes.h"
 #include "LinkUserModel.h"
 #include "log.h"
 
-SkyhookBaseUserModel::SkyhookBaseUserModel(IUserModelSdk *sdk) : sdk(sdk) {
-    // No user input requests are needed, so user model is ready right away
+SkyhookBaseUserModel::SkyhookBaseUserModel(IUserModelSdk *sdk) :
+    sdk(sdk),
+    channelProperties(sdk->getChannelProperties()),
+    timelineCount(metrics.counter("timeline_count")),
+    timelineActionCount(metrics.counter("timeline_action_count")),
+    timelineLatency(metrics.histogram("timeline_latency_us")),
+    transportEventCount(metrics.counter("transport_event_count")),
+    sendPackageCount(metrics.counter("send_package_count")),
+    requestBudgetReqHandle(
+        sdk->requestPluginUserInput(
+               "requestBudget",
+               "Maximum rate of fetches across all links, e.g. 10/s or 1000000/month (default "
+               "unlimited)",
+               true)
+            .handle),
+    logLevelReqHandle(sdk->requestPluginUserInput("logLevel",
+                                                  "Minimum level of messages to log: trace, "
+                                                  "debug, info, warning, or error (default info, "
+                                                  "or as built)",
+                                                  true)
+                          .handle) {
+    // The request budget is optional and unlimited until answered, so the user model is ready
+    // right away
     sdk->updateState(COMPONENT_STATE_STARTED);
 }
 
+// File in the user model's storage directory that metrics are periodically written to
+static const char *METRICS_FILE = "usermodel-metrics.json";
+
+static const double GOLDEN_RATIO_CONJUGATE = 0.6180339887498949;
+
+// Timelines are sized to hold about this many actions with as many links as the channel supports,
+// so that generating them stays cheap however many links it is configured for
+static const double TARGET_TIMELINE_ACTIONS = 20000;
+static const Timestamp MIN_TIMELINE_LENGTH = 60;
+static const Timestamp MAX_TIMELINE_LENGTH = 3600;
+
+// Timelines are regenerated this many times per length, so that consecutive timelines overlap
+static const double FETCHES_PER_TIMELINE_LENGTH = 2;
+
+/**
+ * @brief Get the current time as a timeline timestamp
+ */
+static Timestamp currentTimestamp() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
 ComponentStatus SkyhookBaseUserModel::onUserInputReceived(RaceHandle handle, bool answered,
                                                                   const std::string &response) {
     TRACE_METHOD(handle, answered, response);
-    // We don't make any user input requests
+    if (handle == logLevelReqHandle) {
+        logLevelReqHandle = NULL_RACE_HANDLE;
+        int level;
+        if (answered and parseLogLevel(response, level)) {
+            setLogLevel(level);
+        } else if (answered) {
+            logError(logPrefix + "invalid logLevel '" + response + "', using default");
+        }
+        return COMPONENT_OK;
+    }
+    if (handle != requestBudgetReqHandle) {
+        logWarning(logPrefix + "unexpected user input response");
+        return COMPONENT_OK;
+    }
+
+    double requestsPerSecond = 0;
+    if (answered) {
+        if (RequestBudget::parse(response, requestsPerSecond)) {
+            logInfo(logPrefix + "request budget: " + std::to_string(requestsPerSecond) + " /s");
+        } else {
+            logError(logPrefix + "invalid requestBudget '" + response + "', using unlimited");
+            requestsPerSecond = 0;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requestBudget.setRate(requestsPerSecond);
+        requestBudgetReqHandle = NULL_RACE_HANDLE;
+    }
+    // Links may already be fetching at their polling rate
+    sdk->onTimelineUpdated();
     return COMPONENT_OK;
 }
 
 UserModelProperties SkyhookBaseUserModel::getUserModelProperties() {
     TRACE_METHOD();
-    // TODO implement this
-    return {};
+    // The framework asks for these once, when the user model starts and before any links are
+    // added, so size the timeline for as many links as the channel supports, fetching at the
+    // default polling interval. Fewer or slower links just make for smaller timelines, and links
+    // polling faster than the default for larger ones, which the length bounds keep in check.
+    double maxLinks = std::max(1, channelProperties.maxLinks);
+    double actionRate = maxLinks / DEFAULT_POLLING_INTERVAL;
+
+    Timestamp length = TARGET_TIMELINE_ACTIONS / actionRate;
+    length = std::min(MAX_TIMELINE_LENGTH, std::max(MIN_TIMELINE_LENGTH, length));
+
+    UserModelProperties properties;
+    properties.timelineLength = length;
+    properties.timelineFetchPeriod = length / FETCHES_PER_TIMELINE_LENGTH;
+    logInfo(logPrefix + "timeline length: " + std::to_string(properties.timelineLength) +
+            " s, fetch period: " + std::to_string(properties.timelineFetchPeriod) + " s");
+    return properties;
 }
 
 std::shared_ptr<LinkUserModel> SkyhookBaseUserModel::createLinkUserModel(
-    const LinkID &linkId) {
-    return std::make_shared<LinkUserModel>(linkId, nextActionId);
+    const LinkID &linkId, const LinkParameters &params) {
+    return std::make_shared<LinkUserModel>(linkId, nextActionId, params,
+                                           channelProperties.creatorExpected.send.bandwidth_bps);
 }
 
 ComponentStatus SkyhookBaseUserModel::addLink(const LinkID &link,
-                                                      const LinkParameters & /* params */) {
-    TRACE_METHOD(link);
+                                                      const LinkParameters &params) {
+    TRACE_METHOD(link, params.json);
     {
         std::lock_guard<std::mutex> lock(mutex);
-        linkUserModels[link] = createLinkUserModel(link);
+        auto linkUserModel = createLinkUserModel(link, params);
+        // Successive multiples of the golden ratio spread out evenly over [0, 1) however many
+        // links are added, so the fetches of links added together don't line up
+        double phase = std::fmod(GOLDEN_RATIO_CONJUGATE * linksAdded++, 1.0);
+        linkUserModel->setPhase(phase);
+        linkUserModels[link] = linkUserModel;
         addedLinks.insert(link);
     }
     sdk->onTimelineUpdated();
@@ -63,6 +161,7 @@ ComponentStatus SkyhookBaseUserModel::removeLink(const LinkID &link) {
     {
         std::lock_guard<std::mutex> lock(mutex);
         linkUserModels.erase(link);
+        addedLinks.erase(link);
     }
     sdk->onTimelineUpdated();
     return COMPONENT_OK;
@@ -70,18 +169,24 @@ ComponentStatus SkyhookBaseUserModel::removeLink(const LinkID &link) {
 
 ActionTimeline SkyhookBaseUserModel::getTimeline(Timestamp start, Timestamp end) {
     TRACE_METHOD(start, end);
+    auto generationStart = std::chrono::steady_clock::now();
     std::lock_guard<std::mutex> lock(mutex);
+    timelineUpdatePending = false;
+    allocateRequestBudget(currentTimestamp());
 
-    ActionTimeline timeline;
+    std::vector<const std::deque<Action> *> linkTimelines;
+    linkTimelines.reserve(linkUserModels.size());
     Timestamp earliestTimestamp = std::numeric_limits<double>::max();
     for (auto &entry : linkUserModels) {
         // Skip recently added links for now
         if (addedLinks.find(entry.first) != addedLinks.end()) {
             continue;
         }
-        auto linkTimeline = entry.second->getTimeline(start, end);
-        earliestTimestamp = std::min(earliestTimestamp, linkTimeline.front().timestamp);
-        timeline.insert(timeline.end(), linkTimeline.begin(), linkTimeline.end());
+        auto &linkTimeline = entry.second->getTimeline(start, end);
+        if (not linkTimeline.empty()) {
+            earliestTimestamp = std::min(earliestTimestamp, linkTimeline.front().timestamp);
+        }
+        linkTimelines.push_back(&linkTimeline);
     }
 
     // Create timelines for recently added links, but adjust the start time so that they all occur
@@ -95,37 +200,145 @@ ActionTimeline SkyhookBaseUserModel::getTimeline(Timestamp start, Timestamp end)
         timeAfterEarliestAction = earliestTimestamp + 1.0;
     }
     for (auto &linkId : addedLinks) {
-        auto linkTimeline = linkUserModels.at(linkId)->getTimeline(timeAfterEarliestAction, end);
-        timeline.insert(timeline.end(), linkTimeline.begin(), linkTimeline.end());
+        linkTimelines.push_back(&linkUserModels.at(linkId)->getTimeline(timeAfterEarliestAction, end));
     }
     addedLinks.clear();
 
-    std::sort(timeline.begin(), timeline.end(), [](const auto &lhs, const auto &rhs) {
-        if (lhs.timestamp == rhs.timestamp) {
-            return lhs.actionId < rhs.actionId;
+    ActionTimeline timeline = mergeTimelines(linkTimelines);
+    if (not timeline.empty()) {
+        firstActionTimestamp = timeline.front().timestamp;
+    }
+
+    timelineCount.add();
+    timelineActionCount.add(timeline.size());
+    timelineLatency.recordSince(generationStart);
+    dumpMetrics();
+    return timeline;
+}
+
+ActionTimeline SkyhookBaseUserModel::mergeTimelines(
+    const std::vector<const std::deque<Action> *> &linkTimelines) {
+    // Each link timeline is already sorted, so a k-way merge only has to compare the next action of
+    // each link rather than sorting every action
+    using Cursor = std::pair<std::deque<Action>::const_iterator, std::deque<Action>::const_iterator>;
+    auto later = [](const Cursor &lhs, const Cursor &rhs) {
+        if (lhs.first->timestamp == rhs.first->timestamp) {
+            return lhs.first->actionId > rhs.first->actionId;
         }
-        return lhs.timestamp < rhs.timestamp;
-    });
+        return lhs.first->timestamp > rhs.first->timestamp;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
 
+    size_t size = 0;
+    for (auto linkTimeline : linkTimelines) {
+        if (not linkTimeline->empty()) {
+            heap.push({linkTimeline->begin(), linkTimeline->end()});
+            size += linkTimeline->size();
+        }
+    }
+
+    ActionTimeline timeline;
+    timeline.reserve(size);
+    while (not heap.empty()) {
+        Cursor cursor = heap.top();
+        heap.pop();
+        timeline.push_back(*cursor.first);
+        if (++cursor.first != cursor.second) {
+            heap.push(cursor);
+        }
+    }
     return timeline;
 }
 
-ComponentStatus SkyhookBaseUserModel::onTransportEvent(const Event & /* event */) {
-    TRACE_METHOD();
-    // We don't expect or react to any transport events
+bool SkyhookBaseUserModel::allocateRequestBudget(Timestamp now) {
+    std::vector<LinkUserModel *> links;
+    std::vector<RequestBudget::Demand> demands;
+    links.reserve(linkUserModels.size());
+    demands.reserve(linkUserModels.size());
+    for (auto &entry : linkUserModels) {
+        links.push_back(entry.second.get());
+        demands.push_back(entry.second->getDemand(now));
+    }
+
+    std::vector<double> rates = requestBudget.allocate(demands);
+    bool reallocated = false;
+    for (size_t i = 0; i < links.size(); ++i) {
+        reallocated = links[i]->setAllocatedRate(rates[i]) or reallocated;
+    }
+    return reallocated;
+}
+
+void SkyhookBaseUserModel::dumpMetrics() {
+    if (not metrics.claimDump()) {
+        return;
+    }
+    metrics.gauge("link_count").set(linkUserModels.size());
+    metrics.gauge("request_budget_millirequests_per_second")
+        .set(static_cast<int64_t>(requestBudget.getRate() * 1000));
+    metrics.dump(sdk, METRICS_FILE);
+}
+
+ComponentStatus SkyhookBaseUserModel::onTransportEvent(const Event &event) {
+    TRACE_METHOD(event.json);
+    transportEventCount.add();
+    EventJson eventJson;
+    try {
+        eventJson = nlohmann::json::parse(event.json);
+    } catch (nlohmann::json::exception &error) {
+        logError(logPrefix + "failed to parse event: " + std::string(error.what()));
+        return COMPONENT_OK;
+    }
+
+    bool updated = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = linkUserModels.find(eventJson.linkId);
+        if (iter == linkUserModels.end()) {
+            logDebug(logPrefix + "ignoring event for unknown link " + eventJson.linkId);
+            return COMPONENT_OK;
+        }
+        Timestamp now = currentTimestamp();
+        // The first action of the previous timeline must not change, so changes go after it
+        Timestamp after = std::max(now, firstActionTimestamp);
+        if (eventJson.type == EVENT_DRAIN) {
+            // Fetches the link made on its own to drain a backlog come out of its budget, if any
+            if (requestBudget.getRate() > 0) {
+                updated = iter->second->chargeRequests(eventJson.requests, after);
+            }
+        } else {
+            // Content was just exchanged on the link, so a response is likely to follow shortly
+            iter->second->recordActivity(now);
+            // The link's share of the budget just grew, at the expense of the others, so get the
+            // timeline regenerated now rather than when the cached one runs out. Without a budget
+            // every link gets its polling rate and there is nothing to reallocate.
+            if (requestBudget.getRate() > 0) {
+                updated = allocateRequestBudget(now);
+            }
+            // With a budget, the burst comes out of the link's share rather than on top of it
+            updated = iter->second->addFetchBurst(after, requestBudget.getRate() > 0) or updated;
+        }
+        // Regenerating the timeline of every link is costly, so ask for it once until it happens
+        updated = updated and not timelineUpdatePending;
+        timelineUpdatePending = timelineUpdatePending or updated;
+    }
+    if (updated) {
+        sdk->onTimelineUpdated();
+    }
     return COMPONENT_OK;
 }
 
 ActionTimeline SkyhookBaseUserModel::onSendPackage(const LinkID &linkId,
-                                                             int /* bytes */) {
-    nlohmann::json actionJson = ActionJson{linkId, ACTION_POST};
-    Action action{
-        0,
-        ++nextActionId,
-        actionJson.dump(),
-    };
-
-    return {action};
+                                                             int bytes) {
+    TRACE_METHOD(linkId, bytes);
+    sendPackageCount.add();
+    std::lock_guard<std::mutex> lock(mutex);
+    dumpMetrics();
+    auto iter = linkUserModels.find(linkId);
+    if (iter == linkUserModels.end()) {
+        nlohmann::json actionJson = ActionJson{linkId, ACTION_POST};
+        return {{0, ++nextActionId, actionJson.dump()}};
+    }
+    return {iter->second->getPostAction(currentTimestamp(), bytes)};
 }
 
 
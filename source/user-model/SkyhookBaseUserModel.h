@@ -19,13 +19,19 @@
 #define __COMMS_TWOSIX_USER_MODEL_H__
 
 #include <IUserModelComponent.h>
+#include <ChannelProperties.h>
 #include <ComponentTypes.h>
 
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <unordered_map>
+#include <vector>
+
+#include "Metrics.h"
+#include "RequestBudget.h"
 
 class LinkUserModel;
 
@@ -48,16 +54,62 @@ public:
 
     virtual ActionTimeline onSendPackage(const LinkID &linkId, int bytes) override;
 protected:
-    virtual std::shared_ptr<LinkUserModel> createLinkUserModel(const LinkID &linkId);
+    virtual std::shared_ptr<LinkUserModel> createLinkUserModel(const LinkID &linkId,
+                                                               const LinkParameters &params);
+
+    /**
+     * @brief Merge sorted link timelines into a single timeline, ordered by timestamp and then
+     * action ID.
+     *
+     * @param linkTimelines Timelines of each link, each already sorted
+     * @return Merged action timeline
+     */
+    static ActionTimeline mergeTimelines(const std::vector<const std::deque<Action> *> &linkTimelines);
+
+    /**
+     * @brief Split the request budget across links according to their current demand. Must be
+     * called with the mutex held.
+     *
+     * @param now Current timestamp
+     * @return true if the allocation of any link changed enough to regenerate its timeline
+     */
+    bool allocateRequestBudget(Timestamp now);
+
+    /**
+     * @brief Write the user model's metrics to its storage directory if a dump is due.
+     */
+    void dumpMetrics();
 
 private:
     IUserModelSdk *sdk;
+    ChannelProperties channelProperties;
+
+    MetricsRegistry metrics;
+    Counter &timelineCount;
+    Counter &timelineActionCount;
+    Histogram &timelineLatency;
+    Counter &transportEventCount;
+    Counter &sendPackageCount;
+
+    RaceHandle requestBudgetReqHandle;
+    RaceHandle logLevelReqHandle;
+    RequestBudget requestBudget;
 
     std::mutex mutex;
     std::unordered_map<LinkID, std::shared_ptr<LinkUserModel>> linkUserModels;
 
     std::atomic<uint64_t> nextActionId{0};
 
+    // Number of links added so far, used to spread their fetch phases
+    uint64_t linksAdded{0};
+
+    // Timestamp of the first action of the last generated timeline
+    Timestamp firstActionTimestamp{0};
+
+    // Whether the SDK was told of a timeline update that getTimeline hasn't picked up yet, so that
+    // a run of transport events only gets the timeline regenerated once
+    bool timelineUpdatePending{false};
+
     // TODO remove this when ComponentManager doesn't require the first action to have not changed
     // between generation of timelines
     std::set<LinkID> addedLinks;